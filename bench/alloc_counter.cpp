@@ -0,0 +1,83 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "bench.hpp"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<uint64_t> allocation_count { 0 };
+
+#ifdef __GLIBC__
+/* Qt allocates string data with malloc, so operator new alone isn't enough */
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_calloc(size_t count, size_t size);
+
+void* malloc(size_t size)
+{
+    allocation_count++;
+    return __libc_malloc(size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    allocation_count++;
+    return __libc_realloc(ptr, size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    allocation_count++;
+    return __libc_calloc(count, size);
+}
+}
+#else
+/* Only allocations through operator new are counted on this platform,
+ * which allocations() points out once */
+
+void* operator new(size_t size)
+{
+    allocation_count++;
+    if (void* p = malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+#endif
+
+namespace bench {
+
+uint64_t allocations()
+{
+#ifndef __GLIBC__
+    static bool noted = false;
+    if (!noted) {
+        noted = true;
+        fprintf(stderr, "Note: only allocations through operator new are counted on this platform\n");
+    }
+#endif
+    return allocation_count;
+}
+
+}
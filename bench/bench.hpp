@@ -0,0 +1,56 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace bench {
+
+/* Heap allocations since the program started, see alloc_counter.cpp */
+uint64_t allocations();
+
+struct result {
+    double ns_per_op;
+    double allocations_per_op;
+};
+
+/* Calls fn(round) for a few warm up rounds and then measures rounds calls.
+ * Each call counts as ops operations, so results can be compared between
+ * runs with a different number of outputs */
+template<class F> result run(const char* name, int rounds, int ops, F fn)
+{
+    for (int i = 0; i < rounds / 10 + 1; i++)
+        fn(i);
+
+    const uint64_t start_allocations = allocations();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+        fn(i);
+    const auto end = std::chrono::steady_clock::now();
+
+    const double total_ops = double(rounds) * ops;
+    result r;
+    r.ns_per_op = std::chrono::duration<double, std::nano>(end - start).count() / total_ops;
+    r.allocations_per_op = (allocations() - start_allocations) / total_ops;
+    printf("%-48s %12.1f ns/op %10.3f allocs/op\n", name, r.ns_per_op, r.allocations_per_op);
+    return r;
+}
+
+}
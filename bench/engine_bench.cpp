@@ -0,0 +1,175 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+/* Measures the format engine, output handling and output writing with
+ * synthetic songs, to find out how many outputs a refresh rate allows */
+
+#include "../src/query/music_source.hpp"
+#include "../src/query/song.hpp"
+#include "../src/util/config.hpp"
+#include "../src/util/format.hpp"
+#include "../src/util/log_writer.hpp"
+#include "../src/util/utility.hpp"
+#include "bench.hpp"
+#include <QCoreApplication>
+#include <QTemporaryDir>
+
+#define ROUNDS 20000
+#define WRITE_ROUNDS 2000
+#define LONG_ARTIST_LIST 50
+
+static const char* mixed_formats[] = {
+    "%m - %t",
+    "%T[20] by %M[30]",
+    "%p / %l",
+    "%t (%a, %r)",
+    "%m%e%t%e%a",
+    "Disc %d, track %n: %t",
+};
+
+static song make_song(int artists)
+{
+    song s;
+    s.set_title("A fairly long song title (Extended Remix)");
+    for (int i = 0; i < artists; i++)
+        s.append_artist(QString("Artist number %1").arg(i));
+    s.set_album("Some Album Name");
+    s.set_label("Some Label");
+    s.set_year("2020");
+    s.set_month("04");
+    s.set_day("12");
+    s.set_duration(3 * 60 * 60 * 1000 + 42000);
+    s.set_progress(0);
+    s.set_disc_number(1);
+    s.set_track_number(7);
+    s.set_playing(true);
+    return s;
+}
+
+static void bench_format(const char* name, const char* f, const song& source)
+{
+    song s = source;
+    const format::compiled_format compiled(f);
+    QString out;
+    bench::run(name, ROUNDS, 1, [&](int i) {
+        s.set_progress(i * 1000);
+        out.truncate(0);
+        compiled.execute(out, s);
+    });
+}
+
+/* Returns false if formatting allocated memory. Every changed output is
+ * expected to allocate the text and list node of its write, nothing else */
+static bool bench_outputs(int count, const QString& folder)
+{
+    config::outputs_mutex.lock();
+    config::outputs.clear();
+    for (int i = 0; i < count; i++) {
+        config::output o;
+        o.format = mixed_formats[i % (sizeof(mixed_formats) / sizeof(*mixed_formats))];
+        o.path = folder + QString("/output_%1.txt").arg(i);
+        o.log_mode = false;
+        config::outputs.append(o);
+    }
+    config::outputs_mutex.unlock();
+
+    /* Songs get their generation like thread::publish() gives it to them,
+     * so outputs can skip songs that don't change anything they show */
+    song s = make_song(3);
+    s.update_changes(song());
+    QList<util::output_write> changed, queued;
+
+    const auto progress = QString("handle_outputs, %1 outputs, progress changed").arg(count).toUtf8();
+    const auto r = bench::run(progress.constData(), ROUNDS / count + 1, count, [&](int i) {
+        /* Like a playing song, only outputs with %p are formatted again.
+         * The writer still holds the last batch, like when it lags behind */
+        const song previous = s;
+        s.set_progress((i + 1) * 1000);
+        s.update_changes(previous);
+        queued.swap(changed);
+        /* erase() keeps the list's capacity, clear() wouldn't */
+        changed.erase(changed.begin(), changed.end());
+        util::handle_outputs(s, changed);
+    });
+    /* The same outputs change every round, and setting the progress
+     * detaches the song's record from the previous one once */
+    const double expected = (2.0 * changed.size() + 1) / count;
+
+    const auto unchanged = QString("handle_outputs, %1 outputs, nothing changed").arg(count).toUtf8();
+    const auto skipped = bench::run(unchanged.constData(), ROUNDS / count + 1, count, [&](int) {
+        /* Like a paused song, every output is skipped */
+        const song previous = s;
+        s.update_changes(previous);
+        changed.erase(changed.begin(), changed.end());
+        util::handle_outputs(s, changed);
+    });
+
+    if (r.allocations_per_op > expected || skipped.allocations_per_op > 0) {
+        fprintf(stderr, "Handling %i outputs allocated memory while formatting\n", count);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        fprintf(stderr, "Couldn't create temporary folder\n");
+        return 1;
+    }
+
+    format::init();
+    config::placeholder = "Nothing playing";
+
+    const auto s = make_song(3);
+    const auto many_artists = make_song(LONG_ARTIST_LIST);
+
+    /* The format engine on its own */
+    {
+        QString out;
+        bench::run("format::execute (compiles every time)", ROUNDS, 1, [&](int) {
+            out = "%m - %t (%p / %l)";
+            format::execute(out, s);
+        });
+    }
+    bench_format("title only", "%t", s);
+    bench_format("50 artists", "%m", many_artists);
+    bench_format("truncated and upper case", "%T[12] - %M[20] - %A[5]", s);
+    bench_format("time specifiers", "%p / %l", s);
+    bench_format("sections", "%t%( - %a%)%( (%b)%|%( (%y)%)%)", s);
+    bench_format("all specifiers", "%t %m %a %y %b %r %d %n %p %l%e%s", s);
+
+    /* Formatting and comparing with the last output */
+    bool success = bench_outputs(1, dir.path());
+    success = bench_outputs(12, dir.path()) && success;
+    success = bench_outputs(48, dir.path()) && success;
+
+    /* File I/O */
+    const util::output_write w { dir.path() + "/write.txt", "Artist - Title", false, false, log_writer::rotation() };
+    bench::run("write_song", WRITE_ROUNDS, 1, [&](int) { util::write_song(w); });
+    const util::output_write log { dir.path() + "/log.txt", "Artist - Title", true, false, log_writer::rotation() };
+    bench::run("write_song, log mode (buffered)", WRITE_ROUNDS, 1, [&](int) { util::write_song(log); });
+    log_writer::close_all();
+
+    config::outputs_mutex.lock();
+    config::outputs.clear();
+    config::outputs_mutex.unlock();
+    return success ? 0 : 1;
+}
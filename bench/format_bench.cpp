@@ -0,0 +1,103 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+/* Formats a few outputs over and over and counts heap allocations. Once
+ * every output buffer is large enough, formatting shouldn't allocate at
+ * all, so this exits with an error if it does */
+
+#include "../src/query/music_source.hpp"
+#include "../src/query/song.hpp"
+#include "../src/util/format.hpp"
+#include "bench.hpp"
+#include <QList>
+
+#define ROUNDS 100000
+
+struct bench_output {
+    format::compiled_format compiled;
+    QString buffer, last_output;
+};
+
+int main()
+{
+    format::init();
+
+    song s;
+    s.set_title("Never Gonna Give You Up");
+    s.append_artist("Rick Astley");
+    s.append_artist("Some Featured Artist");
+    s.set_album("Whenever You Need Somebody");
+    s.set_year("1987");
+    s.set_month("07");
+    s.set_day("27");
+    s.set_duration(213000);
+    s.set_progress(0);
+    s.set_disc_number(1);
+    s.set_track_number(1);
+    s.set_playing(true);
+
+    const char* formats[] = {
+        "%m - %t",
+        "%T[10] by %M[15]",
+        "%p / %l",
+        "%a (%r) %d-%n%e%t",
+        "Now playing:%s%t from %a",
+    };
+
+    QList<bench_output> outputs;
+    for (const auto* f : formats) {
+        bench_output o;
+        o.compiled = format::compiled_format(f);
+        outputs.append(o);
+    }
+
+    /* The warm up rounds let the buffers grow to their final size */
+    const auto r = bench::run("steady state formatting", ROUNDS, outputs.size(), [&](int i) {
+        /* Progress changes every refresh, like while a song is playing */
+        s.set_progress((i * 1000) % 213000);
+        for (auto& o : outputs) {
+            o.buffer.truncate(0);
+            o.compiled.execute(o.buffer, s);
+            if (o.buffer != o.last_output)
+                o.last_output.swap(o.buffer);
+        }
+    });
+
+    /* Same as util::handle_outputs does on every refresh: all outputs share
+     * one cache, which is reset once the song changed */
+    format::value_cache cache;
+    const auto cached = bench::run("steady state formatting with value cache", ROUNDS, outputs.size(), [&](int i) {
+        s.set_progress((i * 1000) % 213000);
+        cache.reset();
+        for (auto& o : outputs) {
+            o.buffer.truncate(0);
+            o.compiled.execute(o.buffer, s, &cache);
+            if (o.buffer != o.last_output)
+                o.last_output.swap(o.buffer);
+        }
+    });
+
+    for (const auto& o : outputs)
+        printf("  '%s' -> '%s'\n", qt_to_utf8(o.compiled.source()), qt_to_utf8(o.last_output));
+
+    if (r.allocations_per_op > 0 || cached.allocations_per_op > 0) {
+        fprintf(stderr, "Formatting allocated memory\n");
+        return 1;
+    }
+    return 0;
+}
@@ -4,12 +4,33 @@
 #include "../util/constants.hpp"
 #include "../util/tuna_thread.hpp"
 #include "ui_music_control.h"
+#include <QApplication>
 #include <QDesktopWidget>
 #include <QMenu>
 #include <QStyle>
 #include <obs-frontend-api.h>
 
-music_Control* music_control = nullptr;
+QPointer<music_Control> music_control;
+
+void post_source_changed()
+{
+    QMetaObject::invokeMethod(
+        qApp, [] {
+            if (music_control)
+                emit music_control->source_changed();
+        },
+        Qt::QueuedConnection);
+}
+
+void post_command_finished(int c, bool success)
+{
+    QMetaObject::invokeMethod(
+        qApp, [c, success] {
+            if (music_control)
+                emit music_control->command_finished(c, success);
+        },
+        Qt::QueuedConnection);
+}
 
 music_Control::music_Control(QWidget* parent)
     : QDockWidget(parent)
@@ -36,6 +57,8 @@ music_Control::music_Control(QWidget* parent)
     connect(this, SIGNAL(customContextMenuRequested(const QPoint&)), this, SLOT(showcontextmenu(const QPoint&)));
     connect(this, &music_Control::source_changed, this, &music_Control::on_source_changed);
     connect(this, &music_Control::thread_changed, this, &music_Control::on_thread_changed);
+    /* Posted by the tuna thread through post_command_finished() */
+    connect(this, &music_Control::command_finished, this, &music_Control::on_command_finished);
 
     /* This is dependent on tuna thread speed so lowering this wouldn't make a difference */
     m_timer->start(500);
@@ -74,43 +97,41 @@ music_Control::~music_Control()
 
 void music_Control::on_btn_prev_clicked()
 {
-    thread::thread_mutex.lock();
-    music_sources::selected_source()->execute_capability(CAP_PREV_SONG);
-    thread::thread_mutex.unlock();
+    send_command(CAP_PREV_SONG);
 }
 
 void music_Control::on_btn_play_pause_clicked()
 {
-    thread::thread_mutex.lock();
-    music_sources::selected_source()->execute_capability(CAP_PLAY_PAUSE);
-    thread::thread_mutex.unlock();
+    /* Show the new state right away, it's corrected once the command is done */
+    set_play_icon(!m_playing);
+    send_command(CAP_PLAY_PAUSE);
 }
 
 void music_Control::on_btn_next_clicked()
 {
-    thread::thread_mutex.lock();
-    music_sources::selected_source()->execute_capability(CAP_NEXT_SONG);
-    thread::thread_mutex.unlock();
+    send_command(CAP_NEXT_SONG);
 }
 
 void music_Control::refresh_play_state()
 {
     static QString last_title = "";
-    song copy;
-    thread::copy_mutex.lock();
-    copy = thread::copy;
-    thread::copy_mutex.unlock();
-    QString icon = copy.playing() ? "://images/icons/pause.svg" : "://images/icons/play.svg";
-    ui->btn_play_pause->setIcon(QIcon(icon));
+    const auto current = thread::current_song();
+    /* Don't overwrite the expected state with an outdated one */
+    if (m_pending_commands == 0)
+        set_play_icon(current->playing());
 
     /* refresh song info */
-    if (copy.get_string_value('t') != last_title) {
+    if (current->get_string_value('t') != last_title) {
         QString info = utf8_to_qt(T_DOCK_SONG_INFO);
-        if (copy.playing()) {
-            last_title = copy.get_string_value('t');
-            QString artists, title = copy.get_string_value('t');
-
-            artists = copy.artists().join(", ");
+        if (current->playing()) {
+            last_title = current->get_string_value('t');
+            QString artists, title = current->get_string_value('t');
+
+            for (const auto& artist : current->artists()) {
+                if (!artists.isEmpty())
+                    artists.append(", ");
+                artists.append(artist);
+            }
             info.append(artists);
             info.append(" - ").append(title);
             last_title = title;
@@ -125,12 +146,12 @@ void music_Control::refresh_play_state()
 
 void music_Control::on_source_changed()
 {
-    thread::thread_mutex.lock();
+    /* Capabilities don't change and sources are only selected on the UI
+     * thread, so there's no need to wait for a refresh to finish */
     auto src = music_sources::selected_source();
     uint32_t flags = 0;
     if (src)
         flags = src->get_capabilities();
-    thread::thread_mutex.unlock();
 
     bool next = flags & CAP_NEXT_SONG, prev = flags & CAP_NEXT_SONG, play = flags & CAP_PLAY_PAUSE,
          stop = flags & CAP_STOP_SONG;
@@ -159,17 +180,38 @@ void music_Control::on_source_changed()
 
 void music_Control::on_thread_changed()
 {
-    thread::thread_mutex.lock();
-    auto state = thread::thread_running;
-    thread::thread_mutex.unlock();
-    setEnabled(state);
+    setEnabled(thread::thread_running);
 }
 
 void music_Control::on_btn_stop_clicked()
 {
-    thread::thread_mutex.lock();
-    music_sources::selected_source()->execute_capability(CAP_STOP_SONG);
-    thread::thread_mutex.unlock();
+    set_play_icon(false);
+    send_command(CAP_STOP_SONG);
+}
+
+void music_Control::send_command(int c)
+{
+    m_pending_commands++;
+    /* Doesn't block, the source is only accessed by the tuna thread */
+    thread::post_command(static_cast<capability>(c), [c](bool success) { post_command_finished(c, success); });
+}
+
+void music_Control::on_command_finished(int c, bool success)
+{
+    if (!success)
+        bdebug("Command %i failed", c);
+    if (m_pending_commands > 0)
+        m_pending_commands--;
+    /* The song info was refreshed after the commands ran */
+    if (m_pending_commands == 0)
+        refresh_play_state();
+}
+
+void music_Control::set_play_icon(bool playing)
+{
+    m_playing = playing;
+    QString icon = playing ? "://images/icons/pause.svg" : "://images/icons/play.svg";
+    ui->btn_play_pause->setIcon(QIcon(icon));
 }
 
 void music_Control::showcontextmenu(const QPoint& pos)
@@ -196,9 +238,7 @@ void music_Control::toggle_title()
 
 void music_Control::toggle_volume()
 {
-    thread::thread_mutex.lock();
     auto flags = music_sources::selected_source()->get_capabilities();
-    thread::thread_mutex.unlock();
     if (flags & CAP_VOLUME_UP || flags & CAP_VOLUME_DOWN)
         ui->volume_widget->setVisible(!ui->volume_widget->isVisible());
     save_settings();
@@ -206,14 +246,10 @@ void music_Control::toggle_volume()
 
 void music_Control::on_btn_voldown_clicked()
 {
-    thread::thread_mutex.lock();
-    music_sources::selected_source()->execute_capability(CAP_VOLUME_DOWN);
-    thread::thread_mutex.unlock();
+    send_command(CAP_VOLUME_DOWN);
 }
 
 void music_Control::on_btn_volup_clicked()
 {
-    thread::thread_mutex.lock();
-    music_sources::selected_source()->execute_capability(CAP_VOLUME_UP);
-    thread::thread_mutex.unlock();
+    send_command(CAP_VOLUME_UP);
 }
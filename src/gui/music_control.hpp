@@ -2,6 +2,7 @@
 
 #include "scrolltext.hpp"
 #include <QDockWidget>
+#include <QPointer>
 #include <QTimer>
 
 namespace Ui {
@@ -21,10 +22,12 @@ public:
 signals:
     void source_changed();
     void thread_changed();
+    void command_finished(int c, bool success);
 
 private Q_SLOTS:
     void on_source_changed();
     void on_thread_changed();
+    void on_command_finished(int c, bool success);
     void refresh_play_state();
     void showcontextmenu(const QPoint& pos);
     void toggle_title();
@@ -47,6 +50,22 @@ private:
     Ui::music_Control* ui;
     QTimer* m_timer = nullptr;
     scroll_text* m_song_text = nullptr;
+
+    /* Commands sent to the tuna thread, which haven't finished yet.
+     * While there are any, the play state shown is what we expect it
+     * to be after they're done, instead of the last published one */
+    int m_pending_commands = 0;
+    bool m_playing = false;
+
+    void send_command(int c);
+    void set_play_icon(bool playing);
 };
 
-extern music_Control* music_control;
+/* Reset once OBS destroys the dock with the main window, only
+ * use it on the UI thread */
+extern QPointer<music_Control> music_control;
+
+/* For other threads, the signals are emitted later on the UI thread
+ * if the dock still exists by then */
+void post_source_changed();
+void post_command_finished(int c, bool success);
@@ -18,12 +18,14 @@
 
 #include "output_edit_dialog.hpp"
 #include "../util/constants.hpp"
+#include "../util/utility.hpp"
 #include "tuna_gui.hpp"
 #include "ui_output_edit_dialog.h"
 #include <QDir>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <obs-module.h>
 #ifdef _WIN32
 #include <QTextStream>
 #endif
@@ -36,17 +38,38 @@ output_edit_dialog::output_edit_dialog(edit_mode m, QWidget* parent)
     ui->setupUi(this);
     ui->txt_format->setText(T_SONG_FORMAT_DEFAULT);
     m_tuna = dynamic_cast<tuna_gui*>(parent);
+    connect(ui->cb_text_source, &QCheckBox::toggled, this, &output_edit_dialog::set_text_source);
 
     if (m == edit_mode::modify) {
         QString format, path;
-        bool log_mode = false;
-        m_tuna->get_selected_output(format, path, log_mode);
+        bool log_mode = false, text_source = false;
+        m_tuna->get_selected_output(format, path, log_mode, text_source);
         ui->txt_format->setText(format);
         ui->txt_path->setText(path);
         ui->cb_logmode->setChecked(log_mode);
+        ui->cb_text_source->setChecked(text_source);
     }
 }
 
+void output_edit_dialog::set_text_source(bool on)
+{
+    /* Text sources can't be browsed for and only show one song */
+    ui->pushButton->setEnabled(!on);
+    ui->cb_logmode->setEnabled(!on);
+    if (on)
+        ui->cb_logmode->setChecked(false);
+}
+
+static bool text_source_exists(const QString& name)
+{
+    auto* src = obs_get_source_by_name(name.toUtf8().constData());
+    if (!src)
+        return false;
+    const bool result = util::is_text_source(src);
+    obs_source_release(src);
+    return result;
+}
+
 output_edit_dialog::~output_edit_dialog()
 {
     delete ui;
@@ -72,17 +95,18 @@ static inline bool is_valid_file(const QString& file)
 void output_edit_dialog::on_buttonBox_accepted()
 {
     bool empty = ui->txt_format->text().isEmpty();
-    bool valid = is_valid_file(ui->txt_path->text());
+    bool text_source = ui->cb_text_source->isChecked();
+    bool valid = text_source ? text_source_exists(ui->txt_path->text()) : is_valid_file(ui->txt_path->text());
 
     if (empty || !valid) {
-        QMessageBox::warning(this, T_OUTPUT_ERROR_TITLE, T_OUTPUT_ERROR);
+        QMessageBox::warning(this, T_OUTPUT_ERROR_TITLE, text_source ? T_OUTPUT_SOURCE_ERROR : T_OUTPUT_ERROR);
         return; /* Nothing to do */
     }
 
     if (m_mode == edit_mode::create) {
-        m_tuna->add_output(ui->txt_format->text(), ui->txt_path->text(), ui->cb_logmode->isChecked());
+        m_tuna->add_output(ui->txt_format->text(), ui->txt_path->text(), ui->cb_logmode->isChecked(), text_source);
     } else {
-        m_tuna->edit_output(ui->txt_format->text(), ui->txt_path->text(), ui->cb_logmode->isChecked());
+        m_tuna->edit_output(ui->txt_format->text(), ui->txt_path->text(), ui->cb_logmode->isChecked(), text_source);
     }
 }
 
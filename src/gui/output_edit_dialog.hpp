@@ -41,6 +41,8 @@ private slots:
 
     void on_pushButton_clicked();
 
+    void set_text_source(bool on);
+
 private:
     Ui::output_edit_dialog* ui;
     edit_mode m_mode;
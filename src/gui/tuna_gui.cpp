@@ -44,6 +44,14 @@
 
 tuna_gui* tuna_dialog = nullptr;
 
+/* Whether the output is a text source is kept in the path item */
+static QTableWidgetItem* path_item(const QString& path, bool text_source)
+{
+    auto* item = new QTableWidgetItem(path);
+    item->setData(Qt::UserRole, text_source);
+    return item;
+}
+
 tuna_gui::tuna_gui(QWidget* parent)
     : QDialog(parent)
     , ui(new Ui::tuna_gui)
@@ -57,6 +65,7 @@ tuna_gui::tuna_gui(QWidget* parent)
     connect(this, &tuna_gui::window_source_changed, this, &tuna_gui::update_window);
     connect(this, &tuna_gui::source_registered, this, &tuna_gui::add_music_source);
     connect(this, &tuna_gui::mpd_source_changed, this, &tuna_gui::update_mpd);
+    connect(ui->cb_atomic_writes, &QCheckBox::toggled, ui->cb_atomic_sync, &QCheckBox::setEnabled);
 
     setWindowFlags(windowFlags() & ~Qt::WindowContextHelpButtonHint);
 
@@ -107,9 +116,21 @@ void tuna_gui::toggleShowHide()
         ui->txt_song_cover->setText(utf8_to_qt(config::cover_path));
         ui->txt_song_lyrics->setText(utf8_to_qt(config::lyrics_path));
         ui->sb_refresh_rate->setValue(config::refresh_rate);
+        ui->cb_adaptive_refresh->setChecked(config::adaptive_refresh);
+        ui->cb_throttle_refresh->setChecked(config::throttle_refresh);
+        ui->sb_refresh_recording->setValue(config::recording_refresh_rate);
+        ui->sb_refresh_idle->setValue(config::idle_refresh_rate);
+        ui->cb_suspend_idle->setChecked(config::suspend_when_idle);
         ui->txt_song_placeholder->setText(utf8_to_qt(config::placeholder));
         ui->cb_dl_cover->setChecked(config::download_cover);
+        ui->cb_skip_hidden->setChecked(config::skip_hidden);
+        ui->cb_atomic_writes->setChecked(config::atomic_writes);
+        ui->cb_atomic_sync->setChecked(config::sync_writes);
+        ui->cb_atomic_sync->setEnabled(config::atomic_writes);
+        ui->sb_log_flush->setValue(config::log_flush_interval);
+        ui->cb_log_sync->setChecked(config::sync_logs);
         ui->cb_source->setCurrentIndex(ui->cb_source->findData(utf8_to_qt(config::selected_source)));
+        ui->cb_auto_source->setChecked(config::auto_source);
         set_state();
 
         const auto s = CGET_STR(CFG_SELECTED_SOURCE);
@@ -126,13 +147,15 @@ void tuna_gui::toggleShowHide()
         for (; row < ui->tbl_outputs->rowCount(); row++)
             ui->tbl_outputs->removeRow(row);
         row = 0; /* Load rows */
+        config::outputs_mutex.lock();
         ui->tbl_outputs->setRowCount(config::outputs.size());
         for (const auto& entry : config::outputs) {
             ui->tbl_outputs->setItem(row, 0, new QTableWidgetItem(entry.format));
-            ui->tbl_outputs->setItem(row, 1, new QTableWidgetItem(entry.path));
+            ui->tbl_outputs->setItem(row, 1, path_item(entry.path, entry.text_source));
             ui->tbl_outputs->setItem(row, 2, new QTableWidgetItem(entry.log_mode ? "Yes" : "No"));
             row++;
         }
+        config::outputs_mutex.unlock();
     }
 }
 
@@ -260,10 +283,21 @@ void tuna_gui::on_tuna_gui_accepted()
     CSET_STR(CFG_LYRICS_PATH, qt_to_utf8(ui->txt_song_lyrics->text()));
     QString tmp = ui->cb_source->currentData().toByteArray();
     CSET_STR(CFG_SELECTED_SOURCE, tmp.toStdString().c_str());
+    CSET_BOOL(CFG_SOURCE_AUTO, ui->cb_auto_source->isChecked());
     CSET_UINT(CFG_REFRESH_RATE, ui->sb_refresh_rate->value());
+    CSET_BOOL(CFG_REFRESH_ADAPTIVE, ui->cb_adaptive_refresh->isChecked());
+    CSET_BOOL(CFG_REFRESH_THROTTLE, ui->cb_throttle_refresh->isChecked());
+    CSET_UINT(CFG_REFRESH_RATE_RECORDING, ui->sb_refresh_recording->value());
+    CSET_UINT(CFG_REFRESH_RATE_IDLE, ui->sb_refresh_idle->value());
+    CSET_BOOL(CFG_REFRESH_IDLE_SUSPEND, ui->cb_suspend_idle->isChecked());
 
     CSET_STR(CFG_SONG_PLACEHOLDER, qt_to_utf8(ui->txt_song_placeholder->text()));
     CSET_BOOL(CFG_DOWNLOAD_COVER, ui->cb_dl_cover->isChecked());
+    CSET_BOOL(CFG_SKIP_HIDDEN, ui->cb_skip_hidden->isChecked());
+    CSET_BOOL(CFG_ATOMIC_WRITES, ui->cb_atomic_writes->isChecked());
+    CSET_BOOL(CFG_ATOMIC_SYNC, ui->cb_atomic_sync->isChecked());
+    CSET_UINT(CFG_LOG_FLUSH_INTERVAL, ui->sb_log_flush->value());
+    CSET_BOOL(CFG_LOG_SYNC, ui->cb_log_sync->isChecked());
 
     /* Source settings */
 #if HAVE_MPD
@@ -286,21 +320,34 @@ void tuna_gui::on_tuna_gui_accepted()
 
     CSET_STR(CFG_VLC_ID, qt_to_utf8(ui->cb_vlc_source_name->currentText()));
 
+    config::outputs_mutex.lock();
+    /* Log rotation can only be set in outputs.json, so it's kept from the
+     * output with the same path */
+    const auto previous = config::outputs;
     config::outputs.clear();
     for (int row = 0; row < ui->tbl_outputs->rowCount(); row++) {
         config::output tmp;
         tmp.format = ui->tbl_outputs->item(row, 0)->text();
         tmp.path = ui->tbl_outputs->item(row, 1)->text();
         tmp.log_mode = ui->tbl_outputs->item(row, 2)->text() == "Yes";
+        tmp.text_source = ui->tbl_outputs->item(row, 1)->data(Qt::UserRole).toBool();
+        for (const auto& o : previous) {
+            if (o.path == tmp.path)
+                tmp.rotation = o.rotation;
+        }
         config::outputs.push_back(tmp);
     }
 
     config::save_outputs(config::outputs);
+    config::outputs_mutex.unlock();
     thread::thread_mutex.lock();
     config::refresh_rate = ui->sb_refresh_rate->value();
     thread::thread_mutex.unlock();
 
     config::load();
+    /* The thread might be waiting for a source event, which
+     * would delay applying the new settings */
+    thread::wake();
 
     if (music_control) {
         emit music_control->source_changed();
@@ -370,21 +417,22 @@ void tuna_gui::on_btn_browse_song_lyrics_clicked()
         ui->txt_song_lyrics->setText(path);
 }
 
-void tuna_gui::add_output(const QString& format, const QString& path, bool log_mode)
+void tuna_gui::add_output(const QString& format, const QString& path, bool log_mode, bool text_source)
 {
     int row = ui->tbl_outputs->rowCount();
     ui->tbl_outputs->insertRow(row);
     ui->tbl_outputs->setItem(row, 0, new QTableWidgetItem(format));
-    ui->tbl_outputs->setItem(row, 1, new QTableWidgetItem(path));
+    ui->tbl_outputs->setItem(row, 1, path_item(path, text_source));
     ui->tbl_outputs->setItem(row, 2, new QTableWidgetItem(log_mode ? "Yes" : "No"));
 }
 
-void tuna_gui::edit_output(const QString& format, const QString& path, bool log_mode)
+void tuna_gui::edit_output(const QString& format, const QString& path, bool log_mode, bool text_source)
 {
     auto selection = ui->tbl_outputs->selectedItems();
     if (!selection.empty() && selection.size() > 1) {
         selection.at(0)->setText(format);
         selection.at(1)->setText(path);
+        selection.at(1)->setData(Qt::UserRole, text_source);
         selection.at(2)->setText(log_mode ? "Yes" : "No");
     }
 }
@@ -408,12 +456,13 @@ void tuna_gui::on_btn_remove_output_clicked()
     }
 }
 
-void tuna_gui::get_selected_output(QString& format, QString& path, bool& log_mode)
+void tuna_gui::get_selected_output(QString& format, QString& path, bool& log_mode, bool& text_source)
 {
     auto selection = ui->tbl_outputs->selectedItems();
     if (!selection.empty() && selection.size() > 1) {
         format = selection.at(0)->text();
         path = selection.at(1)->text();
+        text_source = selection.at(1)->data(Qt::UserRole).toBool();
         log_mode = selection.at(2)->text() == "Yes";
     }
 }
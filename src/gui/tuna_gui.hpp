@@ -36,9 +36,9 @@ public:
 
     void toggleShowHide();
 
-    void add_output(const QString& format, const QString& path, bool log_mode);
-    void edit_output(const QString& format, const QString& path, bool log_mode);
-    void get_selected_output(QString& format, QString& path, bool& log_mode);
+    void add_output(const QString& format, const QString& path, bool log_mode, bool text_source);
+    void edit_output(const QString& format, const QString& path, bool log_mode, bool text_source);
+    void get_selected_output(QString& format, QString& path, bool& log_mode, bool& text_source);
 
 signals:
     void login_state_changed(bool sate, QString& log);
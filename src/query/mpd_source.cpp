@@ -23,9 +23,17 @@
 #include "../gui/tuna_gui.hpp"
 #include "../util/config.hpp"
 #include "../util/cover_tag_handler.hpp"
+#include "../util/tuna_thread.hpp"
 #include "../util/utility.hpp"
+#include <errno.h>
 #include <obs-module.h>
+#include <poll.h>
 #include <taglib/fileref.h>
+#include <unistd.h>
+#include <util/platform.h>
+
+/* How long to wait before reconnecting a watcher that lost its connection */
+#define WATCHER_RETRY_NS 10000000000ull
 
 mpd_source::mpd_source()
     : music_source(S_SOURCE_MPD, T_SOURCE_MPD)
@@ -39,6 +47,7 @@ mpd_source::mpd_source()
 
 mpd_source::~mpd_source()
 {
+    stop_watcher();
     if (m_connection)
         mpd_connection_free(m_connection);
     if (m_status)
@@ -79,6 +88,99 @@ void mpd_source::connect()
     }
 }
 
+void mpd_source::start_watcher()
+{
+    if (m_watcher_alive || m_watcher_failed)
+        return;
+
+    const auto now = os_gettime_ns();
+    if (m_watcher.joinable()) {
+        /* Clean up after a watcher that lost its connection, and
+         * don't try again on every refresh */
+        stop_watcher();
+        m_watcher_retry = now + WATCHER_RETRY_NS;
+    }
+    if (now < m_watcher_retry)
+        return;
+
+    if (pipe(m_watch_pipe) != 0) {
+        berr("Couldn't create mpd watcher pipe, falling back to polling");
+        m_watch_pipe[0] = m_watch_pipe[1] = -1;
+        return;
+    }
+
+    m_watcher_alive = true;
+    m_watcher = std::thread(&mpd_source::watch, this, m_address, m_port, m_local);
+}
+
+void mpd_source::stop_watcher()
+{
+    if (m_watcher.joinable()) {
+        /* Interrupts the poll() in watch() */
+        const char c = 0;
+        if (write(m_watch_pipe[1], &c, 1) < 0)
+            berr("Couldn't signal mpd watcher to stop");
+        m_watcher.join();
+    }
+
+    for (auto& fd : m_watch_pipe) {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+}
+
+void mpd_source::watch(QString address, uint16_t port, bool local)
+{
+    struct mpd_connection* connection = nullptr;
+    if (local)
+        connection = mpd_connection_new(nullptr, 0, 0);
+    else
+        connection = mpd_connection_new(qt_to_utf8(address), port, 2000);
+
+    if (mpd_connection_get_error(connection) != MPD_ERROR_SUCCESS) {
+        bwarn("mpd idle connection failed with error %s, falling back to polling",
+            mpd_connection_get_error_message(connection));
+        mpd_connection_free(connection);
+        m_watcher_failed = true;
+        m_watcher_alive = false;
+        return;
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = mpd_connection_get_fd(connection);
+    fds[0].events = POLLIN;
+    fds[1].fd = m_watch_pipe[0];
+    fds[1].events = POLLIN;
+
+    /* MPD answers the idle command once something happened in the
+     * player subsystem (play, pause, stop, seek, song change) */
+    m_watching = mpd_send_idle_mask(connection, MPD_IDLE_PLAYER);
+    while (m_watching) {
+        fds[0].revents = fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno != EINTR)
+                break;
+            continue;
+        }
+
+        if (fds[1].revents)
+            break; /* stop_watcher() was called */
+
+        if (fds[0].revents) {
+            if (mpd_recv_idle(connection, false) == 0 || !mpd_send_idle_mask(connection, MPD_IDLE_PLAYER))
+                break; /* Connection was lost */
+            thread::wake();
+        }
+    }
+
+    m_watching = false;
+    mpd_connection_free(connection);
+    m_watcher_alive = false;
+    /* Make sure the thread goes back to polling */
+    thread::wake();
+}
+
 bool mpd_source::enabled() const
 {
     return true;
@@ -95,6 +197,11 @@ void mpd_source::load()
     m_base_folder = utf8_to_qt(CGET_STR(CFG_MPD_BASE_FOLDER));
     m_port = CGET_UINT(CFG_MPD_PORT);
     m_local = CGET_BOOL(CFG_MPD_LOCAL);
+
+    /* The watcher is started again with the new server on the next refresh */
+    stop_watcher();
+    m_watcher_failed = false;
+    m_watcher_retry = 0;
 }
 
 void mpd_source::save()
@@ -113,6 +220,7 @@ void mpd_source::refresh()
         util::set_placeholder(true);
         return;
     }
+    start_watcher();
 
     bool old_state = m_current.playing();
     m_current.clear();
@@ -133,13 +241,16 @@ void mpd_source::refresh()
 #define MPD_TAG_LABEL (mpd_tag_type)21
 #endif
     if (m_mpd_song) {
+        const auto tag = [this](mpd_tag_type type, capability c) -> const char* {
+            return field_used(c) ? mpd_song_get_tag(m_mpd_song, type, 0) : nullptr;
+        };
         const char* title = mpd_song_get_tag(m_mpd_song, MPD_TAG_TITLE, 0);
         const char* artists = mpd_song_get_tag(m_mpd_song, MPD_TAG_ARTIST, 0);
-        const char* year = mpd_song_get_tag(m_mpd_song, MPD_TAG_DATE, 0);
-        const char* album = mpd_song_get_tag(m_mpd_song, MPD_TAG_ALBUM, 0);
-        const char* num = mpd_song_get_tag(m_mpd_song, MPD_TAG_TRACK, 0);
-        const char* disc = mpd_song_get_tag(m_mpd_song, MPD_TAG_DISC, 0);
-        const char* label = mpd_song_get_tag(m_mpd_song, MPD_TAG_LABEL, 0);
+        const char* year = tag(MPD_TAG_DATE, CAP_RELEASE);
+        const char* album = tag(MPD_TAG_ALBUM, CAP_ALBUM);
+        const char* num = tag(MPD_TAG_TRACK, CAP_TRACK_NUMBER);
+        const char* disc = tag(MPD_TAG_DISC, CAP_DISC_NUMBER);
+        const char* label = tag(MPD_TAG_LABEL, CAP_LABEL);
 
         if (title)
             m_current.set_title(title);
@@ -162,7 +273,9 @@ void mpd_source::refresh()
         QString tmp;
         file_path.prepend(m_base_folder);
 
-        if (m_current.playing()) {
+        if (!field_used(CAP_COVER)) {
+            /* No need to read tags or search for cover files */
+        } else if (m_current.playing()) {
             if (!cover::find_embedded_cover(file_path)) {
                 cover::get_file_folder(file_path);
 
@@ -21,7 +21,9 @@
 #include "music_source.hpp"
 
 #ifdef HAVE_MPD
+#include <atomic>
 #include <mpd/client.h>
+#include <thread>
 
 class mpd_source : public music_source {
     struct mpd_connection* m_connection = nullptr;
@@ -34,6 +36,18 @@ class mpd_source : public music_source {
     uint16_t m_port;
     bool m_local;
 
+    /* A second connection is kept in idle mode, which
+     * wakes the tuna thread up once the player state changes */
+    std::thread m_watcher;
+    std::atomic<bool> m_watcher_alive { false };
+    std::atomic<bool> m_watching { false };
+    /* Set if the server refused the idle connection, the source is
+     * polled until the settings change */
+    std::atomic<bool> m_watcher_failed { false };
+    /* A watcher that lost its connection is only restarted after this */
+    uint64_t m_watcher_retry = 0;
+    int m_watch_pipe[2] = { -1, -1 };
+
 public:
     mpd_source();
     ~mpd_source() override;
@@ -45,11 +59,18 @@ public:
     bool execute_capability(capability c) override;
     bool valid_format(const QString& str) override;
     bool enabled() const override;
+    bool event_driven() const override { return m_watching; }
 
 private:
     void connect();
 
     void disconnect();
+
+    void start_watcher();
+
+    void stop_watcher();
+
+    void watch(QString address, uint16_t port, bool local);
 };
 #else
 
@@ -18,6 +18,7 @@
 
 #include "music_source.hpp"
 #include "../gui/tuna_gui.hpp"
+#include "../util/config.hpp"
 #include "../util/cover_tag_handler.hpp"
 #include "../util/tuna_thread.hpp"
 #include "../util/utility.hpp"
@@ -25,9 +26,11 @@
 #include "spotify_source.hpp"
 #include "vlc_obs_source.hpp"
 #include "window_source.hpp"
+#include <atomic>
 
 namespace music_sources {
-static int selected_index = -1;
+/* Written under thread_mutex, but read by the UI without it */
+static std::atomic<int> selected_index { -1 };
 QList<std::shared_ptr<music_source>> instances;
 
 void init()
@@ -71,6 +74,8 @@ void select(const char* id)
     cover::find_embedded_cover("", true);
 #endif
     thread::thread_mutex.unlock();
+    /* Get info from the new source right away */
+    thread::wake();
 }
 
 void set_gui_values()
@@ -81,8 +86,9 @@ void set_gui_values()
 
 std::shared_ptr<music_source> selected_source()
 {
-    if (selected_index >= 0)
-        return std::shared_ptr<music_source>(instances[selected_index]);
+    const int i = selected_index;
+    if (i >= 0)
+        return std::shared_ptr<music_source>(instances[i]);
     return nullptr;
 }
 
@@ -100,6 +106,22 @@ void deinit()
 }
 }
 
+bool music_source::field_used(capability c)
+{
+    return config::used_fields & c;
+}
+
+std::shared_ptr<const song> music_source::snapshot()
+{
+    if (m_snapshot) {
+        m_current.share_unchanged(*m_snapshot);
+        if (m_current.shares_info_with(*m_snapshot))
+            return m_snapshot;
+    }
+    m_snapshot = std::make_shared<const song>(m_current);
+    return m_snapshot;
+}
+
 music_source::music_source(const char* id, const char* name)
     : m_id(id)
     , m_name(name)
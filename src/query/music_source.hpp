@@ -59,6 +59,9 @@ class music_source : public QObject {
     Q_OBJECT
     const char *m_id, *m_name;
 
+    /* The song as of the last call to snapshot() */
+    std::shared_ptr<const song> m_snapshot;
+
 protected:
     uint32_t m_capabilities = 0x0;
     song m_current = {};
@@ -74,10 +77,21 @@ public:
     bool has_capability(capability c) const { return m_capabilities & ((uint16_t)c); }
 
     const song& song_info() const { return m_current; }
+    /* Called after refresh(), returns the same snapshot as the last call
+     * if nothing changed. Songs share their info, so this doesn't copy
+     * any strings */
+    std::shared_ptr<const song> snapshot();
     void reset_info() { m_current.clear(); }
     const char* name() const { return m_name; }
     const char* id() const { return m_id; }
 
+    /* False if nothing uses this info, so sources don't have to query it */
+    static bool field_used(capability c);
+
+    /* True if the source calls thread::wake() once its state changes,
+     * which means it doesn't have to be polled while nothing is playing */
+    virtual bool event_driven() const { return false; }
+
     /* Abstract stuff */
     virtual bool enabled() const = 0;
     /* Save/load config values */
@@ -19,6 +19,36 @@
 #include "song.hpp"
 #include "music_source.hpp"
 
+/* Shared by all cleared songs, so clearing doesn't allocate and the
+ * first setter only copies a few default strings */
+static const QSharedDataPointer<song_data>& empty_data()
+{
+    static const QSharedDataPointer<song_data> empty = [] {
+        auto* data = new song_data;
+        data->title = "n/a";
+        data->album = "n/a";
+        data->cover = "n/a";
+        data->lyrics = "n/a";
+        return QSharedDataPointer<song_data>(data);
+    }();
+    return empty;
+}
+
+/* Value of the digits at the start of str, so dates like "2020-04-12"
+ * still have a year */
+static int leading_number(const QString& str, int max)
+{
+    int number = 0;
+    for (const auto c : str) {
+        if (!c.isDigit())
+            break;
+        number = number * 10 + c.digitValue();
+        if (number > max)
+            return max;
+    }
+    return number;
+}
+
 song::song()
 {
     clear();
@@ -26,130 +56,178 @@ song::song()
 
 void song::clear()
 {
-    m_data = 0x0;
-    m_title = "n/a";
-    m_album = "n/a";
-    m_cover = "n/a";
-    m_lyrics = "n/a";
-    m_artists.clear();
-    m_disc_number = 0;
-    m_track_number = 0;
-    m_duration_ms = 0;
-    m_progress_ms = 0;
-    m_is_playing = false;
-    m_is_explicit = false;
-    m_release_precision = prec_unknown;
-    m_day = "";
-    m_month = "";
-    m_year = "";
+    d = empty_data();
+}
+
+/* CAP_* flags of all fields that are different */
+static uint32_t differences(const song_data& a, const song_data& b)
+{
+    /* Fields that became (un)available count as changed */
+    uint32_t changed = a.data ^ b.data;
+    const auto check = [&changed](uint32_t flag, bool different) {
+        if (different)
+            changed |= flag;
+    };
+
+    check(CAP_TITLE, a.title != b.title);
+    check(CAP_ARTIST, a.artists != b.artists);
+    check(CAP_ALBUM, a.album != b.album);
+    check(CAP_RELEASE, a.year != b.year || a.month != b.month || a.day != b.day);
+    check(CAP_COVER, a.cover != b.cover);
+    check(CAP_LYRICS, a.lyrics != b.lyrics);
+    check(CAP_DURATION, a.duration_ms != b.duration_ms);
+    check(CAP_EXPLICIT, a.is_explicit != b.is_explicit);
+    check(CAP_DISC_NUMBER, a.disc_number != b.disc_number);
+    check(CAP_TRACK_NUMBER, a.track_number != b.track_number);
+    check(CAP_PROGRESS, a.progress_ms != b.progress_ms);
+    check(CAP_STATUS, a.is_playing != b.is_playing);
+    check(CAP_LABEL, a.label != b.label);
+    return changed;
+}
+
+void song::update_changes(const song& previous)
+{
+    /* Copies of the same song can't be different, constData() doesn't detach */
+    m_changed = d == previous.d ? 0 : differences(*d.constData(), *previous.d.constData());
+    m_generation = previous.m_generation + (m_changed ? 1 : 0);
+}
+
+void song::share_unchanged(const song& previous)
+{
+    if (d == previous.d)
+        return;
+
+    const auto& p = *previous.d.constData();
+    const auto changed = differences(*d.constData(), p);
+    if (!changed) {
+        d = previous.d;
+        return;
+    }
+
+    /* A different track, nothing worth sharing. If the source didn't set
+     * anything after clear() this is still the shared default record, which
+     * has no strings to free and would only detach */
+    if ((changed & (CAP_TITLE | CAP_ARTIST | CAP_ALBUM)) || d == empty_data())
+        return;
+
+    /* The source built this record itself, so it isn't shared and won't detach */
+    d->title = p.title;
+    d->artists = p.artists;
+    d->album = p.album;
+    if (!(changed & CAP_COVER))
+        d->cover = p.cover;
+    if (!(changed & CAP_LYRICS))
+        d->lyrics = p.lyrics;
+    if (!(changed & CAP_LABEL))
+        d->label = p.label;
 }
 
 void song::update_release_precision()
 {
-    if (!m_day.isEmpty() && !m_month.isEmpty() && !m_year.isEmpty()) {
-        m_release_precision = prec_day;
-    } else if (!m_month.isEmpty() && !m_year.isEmpty()) {
-        m_release_precision = prec_month;
-    } else if (!m_year.isEmpty()) {
-        m_release_precision = prec_year;
+    if (d->day && d->month && d->year) {
+        d->release_precision = prec_day;
+    } else if (d->month && d->year) {
+        d->release_precision = prec_month;
+    } else if (d->year) {
+        d->release_precision = prec_year;
     } else {
-        m_release_precision = prec_unknown;
+        d->release_precision = prec_unknown;
     }
 }
 
 void song::append_artist(const QString& a)
 {
     if (!a.isEmpty())
-        m_artists.append(a);
-    if (!m_artists.isEmpty())
-        m_data |= CAP_ARTIST;
+        d->artists.append(a);
+    if (!d->artists.isEmpty())
+        d->data |= CAP_ARTIST;
 }
 
 void song::set_label(const QString& l)
 {
     if (!l.isEmpty())
-        m_data |= CAP_LABEL;
-    m_label = l;
+        d->data |= CAP_LABEL;
+    d->label = l;
 }
 
 void song::set_cover_link(const QString& link)
 {
     if (!link.isEmpty())
-        m_data |= CAP_COVER;
-    m_cover = link;
+        d->data |= CAP_COVER;
+    d->cover = link;
 }
 
 void song::set_title(const QString& title)
 {
     if (!title.isEmpty())
-        m_data |= CAP_TITLE;
-    m_title = title;
+        d->data |= CAP_TITLE;
+    d->title = title;
 }
 
 void song::set_duration(int ms)
 {
     if (ms > 0)
-        m_data |= CAP_DURATION;
-    m_duration_ms = ms;
+        d->data |= CAP_DURATION;
+    d->duration_ms = ms;
 }
 
 void song::set_progress(int ms)
 {
-    m_data |= CAP_PROGRESS;
-    m_progress_ms = ms;
+    d->data |= CAP_PROGRESS;
+    d->progress_ms = ms;
 }
 
 void song::set_album(const QString& album)
 {
     if (!album.isEmpty())
-        m_data |= CAP_ALBUM;
-    m_album = album;
+        d->data |= CAP_ALBUM;
+    d->album = album;
 }
 
 void song::set_explicit(bool e)
 {
-    m_data |= CAP_EXPLICIT;
-    m_is_explicit = e;
+    d->data |= CAP_EXPLICIT;
+    d->is_explicit = e;
 }
 
 void song::set_playing(bool p)
 {
-    m_data |= CAP_STATUS;
-    m_is_playing = p;
+    d->data |= CAP_STATUS;
+    d->is_playing = p;
 }
 
 void song::set_disc_number(int i)
 {
     if (i > 0)
-        m_data |= CAP_DISC_NUMBER;
-    m_disc_number = i;
+        d->data |= CAP_DISC_NUMBER;
+    d->disc_number = i;
 }
 
 void song::set_track_number(int i)
 {
     if (i > 0)
-        m_data |= CAP_TRACK_NUMBER;
-    m_track_number = i;
+        d->data |= CAP_TRACK_NUMBER;
+    d->track_number = i;
 }
 
 void song::set_year(const QString& y)
 {
-    m_data |= CAP_RELEASE;
-    m_year = y;
+    d->data |= CAP_RELEASE;
+    d->year = uint16_t(leading_number(y, UINT16_MAX));
     update_release_precision();
 }
 
 void song::set_month(const QString& m)
 {
-    m_data |= CAP_RELEASE;
-    m_month = m;
+    d->data |= CAP_RELEASE;
+    d->month = uint8_t(leading_number(m, 12));
     update_release_precision();
 }
 
-void song::set_day(const QString& d)
+void song::set_day(const QString& day)
 {
-    m_data |= CAP_RELEASE;
-    m_day = d;
+    d->data |= CAP_RELEASE;
+    d->day = uint8_t(leading_number(day, 31));
     update_release_precision();
 }
 
@@ -159,13 +237,11 @@ const QString& song::get_string_value(char specifier) const
 
     switch (specifier) {
     case 't':
-        return m_title;
+        return d->title;
     case 'a':
-        return m_album;
-    case 'y':
-        return m_year;
+        return d->album;
     case 'b':
-        return m_label;
+        return d->label;
     default:
         return empty;
     }
@@ -175,13 +251,15 @@ int32_t song::get_int_value(char specifier) const
 {
     switch (specifier) {
     case 'd':
-        return m_disc_number;
+        return d->disc_number;
     case 'a':
-        return m_track_number;
+        return d->track_number;
     case 'p':
-        return m_progress_ms;
+        return d->progress_ms;
     case 'l':
-        return m_duration_ms;
+        return d->duration_ms;
+    case 'y':
+        return d->year;
     default:
         return 0;
     }
@@ -17,8 +17,9 @@
  *************************************************************************/
 
 #pragma once
-#include <QList>
+#include <QSharedData>
 #include <QString>
+#include <QVarLengthArray>
 #include <stdint.h>
 
 enum date_precision { prec_day,
@@ -26,18 +27,34 @@ enum date_precision { prec_day,
     prec_year,
     prec_unknown };
 
+/* Most songs have only a few artists, which are stored inline */
+typedef QVarLengthArray<QString, 4> artist_array;
+
+/* The song info itself, which is shared between copies of a song until
+ * one of them is modified */
+class song_data : public QSharedData {
+public:
+    uint16_t data = 0;
+    QString title, album, cover, lyrics, label;
+    artist_array artists;
+    /* Zero if unknown */
+    uint16_t year = 0;
+    uint8_t month = 0, day = 0;
+    int32_t disc_number = 0, track_number = 0, duration_ms = 0, progress_ms = 0;
+    bool is_explicit = false, is_playing = false;
+    date_precision release_precision = prec_unknown;
+};
+
+/* Copying a song only copies a pointer and the change tracking */
 class song {
-    uint16_t m_data;
-    QString m_title, m_album, m_cover, m_lyrics, m_label;
-    QList<QString> m_artists;
-    QString m_year, m_month, m_day;
-    int32_t m_disc_number, m_track_number, m_duration_ms, m_progress_ms;
-    bool m_is_explicit, m_is_playing;
-    date_precision m_release_precision;
+    QSharedDataPointer<song_data> d;
+    uint64_t m_generation = 0;
+    uint32_t m_changed = 0;
+
+    void update_release_precision();
 
 public:
     song();
-    void update_release_precision();
     void append_artist(const QString& a);
     void set_cover_link(const QString& link);
     void set_title(const QString& title);
@@ -48,22 +65,40 @@ public:
     void set_playing(bool p);
     void set_disc_number(int i);
     void set_track_number(int i);
+    /* Dates are parsed from their leading digits, e.g. "2020-04-12" is
+     * year 2020 and "07" is month 7 */
     void set_year(const QString& y);
     void set_month(const QString& m);
     void set_day(const QString& d);
     void set_label(const QString& l);
     void clear();
 
-    bool playing() const { return m_is_playing; }
-    uint16_t data() const { return m_data; }
-    const QString& cover() const { return m_cover; }
-    const QString& lyrics() const { return m_lyrics; }
-    const QString& year() const { return m_year; }
-    const QString& month() const { return m_month; }
-    const QString& day() const { return m_day; }
-    const QString& label() const { return m_label; }
+    /* Called on published songs with the song that was published before.
+     * The generation only goes up if anything changed and changed() has
+     * the CAP_* flag of every field that is different. Sources clear and
+     * set all fields on every refresh, so this can't be tracked by the
+     * setters */
+    void update_changes(const song& previous);
+
+    /* Called by sources after a refresh with the song of the last refresh.
+     * If nothing changed this shares its record, and if it's still the
+     * same track (e.g. only the progress moved) the track's strings are
+     * shared, so the new ones can be freed */
+    void share_unchanged(const song& previous);
+    bool shares_info_with(const song& other) const { return d == other.d; }
+    uint64_t generation() const { return m_generation; }
+    uint32_t changed() const { return m_changed; }
+
+    bool playing() const { return d->is_playing; }
+    uint16_t data() const { return d->data; }
+    const QString& cover() const { return d->cover; }
+    const QString& lyrics() const { return d->lyrics; }
+    int year() const { return d->year; }
+    int month() const { return d->month; }
+    int day() const { return d->day; }
+    const QString& label() const { return d->label; }
     const QString& get_string_value(char specififer) const;
-    const QList<QString>& artists() const { return m_artists; }
+    const artist_array& artists() const { return d->artists; }
     int32_t get_int_value(char specifier) const;
-    date_precision release_precision() const { return m_release_precision; }
+    date_precision release_precision() const { return d->release_precision; }
 };
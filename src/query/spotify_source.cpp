@@ -229,7 +229,7 @@ void spotify_source::parse_track_json(const QJsonValue& track)
 
     /* Cover link */
     const auto& covers = album["images"];
-    if (covers.isArray()) {
+    if (field_used(CAP_COVER) && covers.isArray()) {
         const QJsonValue v = covers.toArray()[0];
         if (v.isObject() && v.toObject().contains("url"))
             m_current.set_cover_link(v.toObject()["url"].toString());
@@ -238,12 +238,18 @@ void spotify_source::parse_track_json(const QJsonValue& track)
     /* Other stuff */
     m_current.set_title(trackObj["name"].toString());
     m_current.set_duration(trackObj["duration_ms"].toInt());
-    m_current.set_album(album["name"].toString());
-    m_current.set_explicit(trackObj["explicit"].toBool());
-    m_current.set_disc_number(trackObj["disc_number"].toInt());
-    m_current.set_track_number(trackObj["track_number"].toInt());
+    if (field_used(CAP_ALBUM))
+        m_current.set_album(album["name"].toString());
+    if (field_used(CAP_EXPLICIT))
+        m_current.set_explicit(trackObj["explicit"].toBool());
+    if (field_used(CAP_DISC_NUMBER))
+        m_current.set_disc_number(trackObj["disc_number"].toInt());
+    if (field_used(CAP_TRACK_NUMBER))
+        m_current.set_track_number(trackObj["track_number"].toInt());
 
     /* Release date */
+    if (!field_used(CAP_RELEASE))
+        return;
     const auto& date = album["release_date"].toString();
     if (date.length() > 0) {
         QStringList list = date.split("-");
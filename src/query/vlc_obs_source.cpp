@@ -133,14 +133,17 @@ void vlc_obs_source::refresh()
 
         auto* media = libvlc_media_player_get_media_(vlc->media_player);
         if (m_current.playing() && media) {
+            const auto meta = [media](libvlc_meta_t type, capability c) -> const char* {
+                return field_used(c) ? libvlc_media_get_meta_(media, type) : nullptr;
+            };
             const char* title = libvlc_media_get_meta_(media, libvlc_meta_Title);
             const char* artists = libvlc_media_get_meta_(media, libvlc_meta_Artist);
-            const char* year = libvlc_media_get_meta_(media, libvlc_meta_Date);
-            const char* album = libvlc_media_get_meta_(media, libvlc_meta_Album);
-            const char* num = libvlc_media_get_meta_(media, libvlc_meta_TrackID);
-            const char* disc = libvlc_media_get_meta_(media, libvlc_meta_DiscNumber);
-            const char* cover = libvlc_media_get_meta_(media, libvlc_meta_ArtworkURL);
-            const char* label = libvlc_media_get_meta_(media, libvlc_meta_Publisher);
+            const char* year = meta(libvlc_meta_Date, CAP_RELEASE);
+            const char* album = meta(libvlc_meta_Album, CAP_ALBUM);
+            const char* num = meta(libvlc_meta_TrackID, CAP_TRACK_NUMBER);
+            const char* disc = meta(libvlc_meta_DiscNumber, CAP_DISC_NUMBER);
+            const char* cover = meta(libvlc_meta_ArtworkURL, CAP_COVER);
+            const char* label = meta(libvlc_meta_Publisher, CAP_LABEL);
 
             if (title)
                 m_current.set_title(title);
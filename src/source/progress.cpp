@@ -32,16 +32,13 @@ progress_source::~progress_source() {}
 
 void progress_source::tick(float seconds)
 {
-    song tmp;
-    thread::copy_mutex.lock();
-    tmp = thread::copy;
-    thread::copy_mutex.unlock();
-    m_active = tmp.playing();
+    const auto tmp = thread::current_song();
+    m_active = tmp->playing();
     if (m_active) {
         seconds *= 1000; /* s -> ms */
-        if ((tmp.data() & CAP_DURATION) && (tmp.data() & CAP_PROGRESS)) {
-            if (tmp.get_int_value('p') != m_synced_progress) {
-                m_synced_progress = tmp.get_int_value('p');
+        if ((tmp->data() & CAP_DURATION) && (tmp->data() & CAP_PROGRESS)) {
+            if (tmp->get_int_value('p') != m_synced_progress) {
+                m_synced_progress = tmp->get_int_value('p');
                 m_adjusted_progress = m_synced_progress + seconds;
             } else {
                 m_adjusted_progress += seconds;
@@ -51,7 +48,7 @@ void progress_source::tick(float seconds)
         }
 
 
-        float duration = tmp.get_int_value('l');
+        float duration = tmp->get_int_value('l');
         if (duration > 0)
             m_progress = m_adjusted_progress / duration;
     } else {
@@ -23,8 +23,10 @@
 #include "util/config.hpp"
 #include "util/constants.hpp"
 #include "util/format.hpp"
+#include "util/source_pool.hpp"
 #include "util/tuna_thread.hpp"
 #include "util/utility.hpp"
+#include "util/visibility.hpp"
 #include <QAction>
 #include <QMainWindow>
 #include <obs-frontend-api.h>
@@ -49,12 +51,40 @@ void register_gui()
 
 #ifndef __APPLE__
     obs_frontend_push_ui_translation(obs_module_get_string);
-    auto* tmp = new music_Control(main_window);
-    music_control = reinterpret_cast<music_Control*>(obs_frontend_add_dock(tmp));
+    auto* dock = new music_Control(main_window);
+    /* This returns the dock's toggle action, not the dock */
+    obs_frontend_add_dock(dock);
+    music_control = dock;
     obs_frontend_pop_ui_translation();
 #endif
 }
 
+static void frontend_event(enum obs_frontend_event event, void*)
+{
+    switch (event) {
+    case OBS_FRONTEND_EVENT_STREAMING_STARTED:
+    case OBS_FRONTEND_EVENT_STREAMING_STOPPED:
+    case OBS_FRONTEND_EVENT_RECORDING_STARTED:
+    case OBS_FRONTEND_EVENT_RECORDING_STOPPED:
+    case OBS_FRONTEND_EVENT_REPLAY_BUFFER_STARTED:
+    case OBS_FRONTEND_EVENT_REPLAY_BUFFER_STOPPED:
+    case OBS_FRONTEND_EVENT_FINISHED_LOADING:
+        if (obs_frontend_streaming_active())
+            thread::set_output_state(thread::OUTPUT_LIVE);
+        else if (obs_frontend_recording_active() || obs_frontend_replay_buffer_active())
+            thread::set_output_state(thread::OUTPUT_RECORDING);
+        else
+            thread::set_output_state(thread::OUTPUT_IDLE);
+        break;
+    case OBS_FRONTEND_EVENT_EXIT:
+        /* The dock is destroyed with the main window, which happens
+         * before the module is unloaded */
+        thread::stop();
+        break;
+    default:;
+    }
+}
+
 bool obs_module_load()
 {
     binfo("Loading v%s", BUILD_TIME);
@@ -66,12 +96,18 @@ bool obs_module_load()
     music_sources::init();
     config::load();
     obs_sources::register_progress();
+    obs_frontend_add_event_callback(frontend_event, nullptr);
+    visibility::init();
     return true;
 }
 
 void obs_module_unload()
 {
+    obs_frontend_remove_event_callback(frontend_event, nullptr);
+    visibility::deinit();
     thread::thread_mutex.lock();
+    /* The vlc source might still be refreshing on the pool */
+    source_pool::wait_idle();
     util::unload_vlc();
     thread::thread_mutex.unlock();
     config::close();
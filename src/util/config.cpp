@@ -20,6 +20,7 @@
 #include "../query/music_source.hpp"
 #include "../util/tuna_thread.hpp"
 #include "constants.hpp"
+#include "source_pool.hpp"
 #include "utility.hpp"
 #include <QDir>
 #include <QJsonArray>
@@ -35,13 +36,27 @@ namespace config {
 
 config_t* instance = nullptr;
 uint16_t refresh_rate = 1000;
+bool adaptive_refresh = false;
+uint16_t paused_refresh_rate = 5000;
+bool throttle_refresh = false;
+uint16_t recording_refresh_rate = 1000;
+uint16_t idle_refresh_rate = 5000;
+bool suspend_when_idle = false;
 const char* placeholder = nullptr;
 const char* cover_path = nullptr;
 const char* lyrics_path = nullptr;
 const char* selected_source = nullptr;
+bool auto_source = false;
 QList<output> outputs;
+std::mutex outputs_mutex;
 const char* cover_placeholder = nullptr;
 bool download_cover = true;
+bool skip_hidden = false;
+bool atomic_writes = false;
+bool sync_writes = false;
+uint16_t log_flush_interval = 1000;
+bool sync_logs = false;
+std::atomic<uint32_t> used_fields { 0xffffffff };
 
 void init()
 {
@@ -57,12 +72,24 @@ void init()
     CDEF_STR(CFG_COVER_PATH, qt_to_utf8(path_cover_art));
     CDEF_STR(CFG_LYRICS_PATH, qt_to_utf8(path_lyrics));
     CDEF_STR(CFG_SELECTED_SOURCE, S_SOURCE_SPOTIFY);
+    CDEF_BOOL(CFG_SOURCE_AUTO, auto_source);
 
     CDEF_BOOL(CFG_RUNNING, false);
     CDEF_BOOL(CFG_DOWNLOAD_COVER, true);
+    CDEF_BOOL(CFG_SKIP_HIDDEN, skip_hidden);
+    CDEF_BOOL(CFG_ATOMIC_WRITES, atomic_writes);
+    CDEF_BOOL(CFG_ATOMIC_SYNC, sync_writes);
+    CDEF_UINT(CFG_LOG_FLUSH_INTERVAL, log_flush_interval);
+    CDEF_BOOL(CFG_LOG_SYNC, sync_logs);
     CDEF_BOOL(CFG_FORCE_VLC_DECISION, false);
     CDEF_BOOL(CFG_ERROR_MESSAGE_SHOWN, false);
     CDEF_UINT(CFG_REFRESH_RATE, refresh_rate);
+    CDEF_BOOL(CFG_REFRESH_ADAPTIVE, adaptive_refresh);
+    CDEF_UINT(CFG_REFRESH_RATE_PAUSED, paused_refresh_rate);
+    CDEF_BOOL(CFG_REFRESH_THROTTLE, throttle_refresh);
+    CDEF_UINT(CFG_REFRESH_RATE_RECORDING, recording_refresh_rate);
+    CDEF_UINT(CFG_REFRESH_RATE_IDLE, idle_refresh_rate);
+    CDEF_BOOL(CFG_REFRESH_IDLE_SUSPEND, suspend_when_idle);
     CDEF_STR(CFG_SONG_PLACEHOLDER, T_PLACEHOLDER);
 
     CDEF_BOOL(CFG_DOCK_VISIBLE, false);
@@ -73,22 +100,58 @@ void init()
         cover_placeholder = obs_module_file("placeholder.png");
 }
 
+/* Shown in the dock, or needed for scheduling and the progress source */
+#define ALWAYS_USED_FIELDS (CAP_TITLE | CAP_ARTIST | CAP_STATUS | CAP_PROGRESS | CAP_DURATION)
+
+static void update_used_fields()
+{
+    uint32_t fields = ALWAYS_USED_FIELDS;
+    if (download_cover)
+        fields |= CAP_COVER;
+
+    outputs_mutex.lock();
+    for (auto& o : outputs) {
+        if (o.compiled.source() != o.format)
+            o.compiled = format::compiled_format(o.format);
+        fields |= o.compiled.fields();
+    }
+    outputs_mutex.unlock();
+    used_fields = fields;
+}
+
 void load()
 {
     if (!instance)
         init();
     bool run = CGET_BOOL(CFG_RUNNING);
 
+    outputs_mutex.lock();
     load_outputs(outputs);
+    outputs_mutex.unlock();
     cover_path = CGET_STR(CFG_COVER_PATH);
     lyrics_path = CGET_STR(CFG_LYRICS_PATH);
     refresh_rate = CGET_UINT(CFG_REFRESH_RATE);
+    adaptive_refresh = CGET_BOOL(CFG_REFRESH_ADAPTIVE);
+    paused_refresh_rate = CGET_UINT(CFG_REFRESH_RATE_PAUSED);
+    throttle_refresh = CGET_BOOL(CFG_REFRESH_THROTTLE);
+    recording_refresh_rate = CGET_UINT(CFG_REFRESH_RATE_RECORDING);
+    idle_refresh_rate = CGET_UINT(CFG_REFRESH_RATE_IDLE);
+    suspend_when_idle = CGET_BOOL(CFG_REFRESH_IDLE_SUSPEND);
     placeholder = CGET_STR(CFG_SONG_PLACEHOLDER);
     download_cover = CGET_BOOL(CFG_DOWNLOAD_COVER);
+    skip_hidden = CGET_BOOL(CFG_SKIP_HIDDEN);
+    atomic_writes = CGET_BOOL(CFG_ATOMIC_WRITES);
+    sync_writes = CGET_BOOL(CFG_ATOMIC_SYNC);
+    log_flush_interval = CGET_UINT(CFG_LOG_FLUSH_INTERVAL);
+    sync_logs = CGET_BOOL(CFG_LOG_SYNC);
+    update_used_fields();
     selected_source = CGET_STR(CFG_SELECTED_SOURCE);
+    auto_source = CGET_BOOL(CFG_SOURCE_AUTO);
 
-    /* Sources */
+    /* Sources. New refreshes are only queued under thread_mutex, so
+     * once the pool is idle no source is in use */
     thread::thread_mutex.lock();
+    source_pool::wait_idle();
     music_sources::load();
     thread::thread_mutex.unlock();
 
@@ -101,20 +164,21 @@ void load()
 void save()
 {
     music_sources::save();
+    outputs_mutex.lock();
     save_outputs(outputs);
+    outputs_mutex.unlock();
 }
 
 void close()
 {
     thread::thread_mutex.lock();
+    source_pool::wait_idle();
     save();
     util::reset_cover();
-    thread::stop();
     thread::thread_mutex.unlock();
 
-    /* Wait for thread to exit to delete resources */
-    while (thread::thread_running)
-        os_sleep_ms(5);
+    /* Joins the thread, so its resources can be deleted afterwards */
+    thread::stop();
     bfree((void*)cover_placeholder);
     thread::thread_mutex.lock();
     music_sources::deinit();
@@ -144,6 +208,10 @@ void load_outputs(QList<output>& table_content)
             else
                 tmp.log_mode = false;
 
+            tmp.text_source = obj[JSON_OUTPUT_TEXT_SOURCE].toBool();
+            tmp.rotation.max_kb = uint32_t(qMax(0, obj[JSON_LOG_ROTATE_SIZE].toInt()));
+            tmp.rotation.max_minutes = uint32_t(qMax(0, obj[JSON_LOG_ROTATE_TIME].toInt()));
+
             if (obj[JSON_LAST_OUTPUT].isString())
                 tmp.last_output = obj[JSON_LAST_OUTPUT].isString();
             else
@@ -182,9 +250,16 @@ void save_outputs(const QList<output>& outputs)
     for (const auto& o : outputs) {
         QJsonObject output;
         output[JSON_FORMAT_ID] = o.format;
-        output[JSON_OUTPUT_PATH_ID] = QDir::toNativeSeparators(o.path);
+        /* Source names aren't paths */
+        output[JSON_OUTPUT_PATH_ID] = o.text_source ? o.path : QDir::toNativeSeparators(o.path);
         output[JSON_FORMAT_LOG_MODE] = o.log_mode;
         output[JSON_LAST_OUTPUT] = o.last_output;
+        if (o.text_source)
+            output[JSON_OUTPUT_TEXT_SOURCE] = true;
+        if (o.rotation.max_kb)
+            output[JSON_LOG_ROTATE_SIZE] = int(o.rotation.max_kb);
+        if (o.rotation.max_minutes)
+            output[JSON_LOG_ROTATE_TIME] = int(o.rotation.max_minutes);
         output_array.append(output);
     }
 
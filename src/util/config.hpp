@@ -18,8 +18,12 @@
 
 #pragma once
 
+#include "format.hpp"
+#include "log_writer.hpp"
 #include <QList>
 #include <QString>
+#include <atomic>
+#include <mutex>
 #include <util/config-file.h>
 
 /* Config macros */
@@ -47,10 +51,22 @@
 #define CFG_COVER_PATH 					"cover_path"
 #define CFG_LYRICS_PATH 				"lyrics_path"
 #define CFG_SELECTED_SOURCE 			"music.source"
+#define CFG_SOURCE_AUTO					"music.source.auto"
 #define CFG_REFRESH_RATE 				"refresh_rate"
+#define CFG_REFRESH_ADAPTIVE			"refresh_rate.adaptive"
+#define CFG_REFRESH_RATE_PAUSED			"refresh_rate.paused"
+#define CFG_REFRESH_THROTTLE			"refresh_rate.throttle"
+#define CFG_REFRESH_RATE_RECORDING		"refresh_rate.recording"
+#define CFG_REFRESH_RATE_IDLE			"refresh_rate.idle"
+#define CFG_REFRESH_IDLE_SUSPEND		"refresh_rate.idle.suspend"
 #define CFG_SONG_FORMAT 				"song_format"
 #define CFG_SONG_PLACEHOLDER 			"song_placeholder"
 #define CFG_DOWNLOAD_COVER 				"download_cover"
+#define CFG_SKIP_HIDDEN					"skip_hidden"
+#define CFG_ATOMIC_WRITES				"output.atomic"
+#define CFG_ATOMIC_SYNC					"output.atomic.sync"
+#define CFG_LOG_FLUSH_INTERVAL			"output.log.flush_interval"
+#define CFG_LOG_SYNC					"output.log.sync"
 
 #define CFG_SPOTIFY_LOGGEDIN 			"spotify.login"
 #define CFG_SPOTIFY_TOKEN 				"spotify.token"
@@ -86,20 +102,50 @@ struct output {
     QString format;
     QString path;
     QString last_output;
+    /* Formatting happens in here, it's swapped with last_output if it's
+     * different, so both keep their capacity between refreshes */
+    QString buffer;
     bool log_mode;
+    /* path is the name of an OBS text source, which is updated directly */
+    bool text_source = false;
+    log_writer::rotation rotation;
+    /* Recompiled once format doesn't match its source anymore */
+    format::compiled_format compiled;
+    /* Generation of the song last_output was made from, zero if it has
+     * to be formatted again regardless of what changed */
+    uint64_t generation = 0;
 };
 
 extern config_t* instance;
 
 /* Temp storage for config values */
 extern uint16_t refresh_rate;
+extern bool adaptive_refresh;
+extern uint16_t paused_refresh_rate;
+extern bool throttle_refresh;
+extern uint16_t recording_refresh_rate;
+extern uint16_t idle_refresh_rate;
+extern bool suspend_when_idle;
 extern const char* placeholder;
 extern const char* selected_source;
+extern bool auto_source;
 extern const char* cover_path;
 extern const char* lyrics_path;
 extern QList<output> outputs;
+/* Outputs are formatted on the pipeline's format thread */
+extern std::mutex outputs_mutex;
 extern const char* cover_placeholder;
 extern bool download_cover;
+extern bool skip_hidden;
+extern bool atomic_writes;
+extern bool sync_writes;
+/* How long log lines are buffered in ms, zero writes them right away */
+extern uint16_t log_flush_interval;
+extern bool sync_logs;
+
+/* CAP_* flags of all song info that is used by outputs, the dock or the
+ * progress source. Sources can skip querying everything else */
+extern std::atomic<uint32_t> used_fields;
 
 void init();
 
@@ -62,6 +62,7 @@
 
 #define T_OUTPUT_ERROR_TITLE 	T_("tuna.gui.output.edit.dialog.error.title")
 #define T_OUTPUT_ERROR 			T_("tuna.gui.output.edit.dialog.error")
+#define T_OUTPUT_SOURCE_ERROR 	T_("tuna.gui.output.edit.dialog.error.source")
 
 #define T_VLC_NONE 				T_("tuna.gui.vlc.none")
 #define T_VLC_VERSION_ISSUE		T_("tuna.gui.vlc.issue.message")
@@ -95,6 +96,9 @@
 #define JSON_FORMAT_ID 			"format"
 #define JSON_FORMAT_LOG_MODE	"log_mode"
 #define JSON_LAST_OUTPUT		"last_output"
+#define JSON_OUTPUT_TEXT_SOURCE	"text_source"
+#define JSON_LOG_ROTATE_SIZE	"log_rotate_kb"
+#define JSON_LOG_ROTATE_TIME	"log_rotate_minutes"
 
 #define STATUS_RETRY_AFTER 		429
 #define HTTP_NO_CONTENT			204
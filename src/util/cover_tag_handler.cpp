@@ -169,6 +169,9 @@ bool find_embedded_cover(const QString& path, bool reset)
         return false;
     }
 
+    if (util::mute_covers)
+        return false;
+
     if (last_file == path) {
         result = true;
     } else {
@@ -20,176 +20,383 @@
 #include "../query/music_source.hpp"
 #include "../query/song.hpp"
 #include "../util/config.hpp"
-#include <memory>
 
 namespace format {
 
-static std::vector<std::unique_ptr<specifier>> specifiers;
+static specifier specifiers[SPECIFIER_COUNT];
 
-const specifier* get_matching_specifier(char c)
+static const specifier* get_matching_specifier(char c)
 {
-    for (const auto& s : specifiers) {
-        if (s->get_id() == c)
-            return s.get();
-    }
-    return nullptr;
+    if (c < 0 || c >= SPECIFIER_COUNT || !specifiers[int(c)].append)
+        return nullptr;
+    return &specifiers[int(c)];
 }
 
-/* Find the number in between '[]' in
- * a string like t[123] abc
- * and remove the '[123]' part
- */
-int get_truncate_arg(QString& str)
+/* Parses the number in a slice like t[123] abc and returns it. consumed
+ * is set to the length of the specifier including the '[123]' part, which
+ * is only skipped if it contains a valid number */
+static int get_truncate_arg(const QString& str, int& consumed)
 {
-    int number = 0;
-    QString tmp = "", copy = str;
-    bool ok = false;
-
+    consumed = 1;
     if (str.length() < 4 || str[1] != '[')
-        return number;
-    copy.remove(1, 1); /* remove '[' */
-
-    bool flag = true;
-    while (!copy.isEmpty() && flag) {
-        if (copy[1].isNumber())
-            tmp.append(copy[1]);
-        else if (copy[1] == ']')
-            flag = false; /* We're done */
-        else
+        return 0;
+
+    QString tmp;
+    int i = 2;
+    for (; i < str.length(); i++) {
+        if (str[i].isNumber()) {
+            tmp.append(str[i]);
+        } else {
+            if (str[i] == ']')
+                i++; /* We're done */
             break; /* Unknown character -> stop */
-        copy.remove(1, 1); /* consume character */
+        }
     }
 
-    number = tmp.toInt(&ok);
+    bool ok = false;
+    int number = tmp.toInt(&ok);
+    if (!ok)
+        return 0;
+    consumed = i;
+    return number;
+}
 
-    if (ok)
-        str = copy;
-    else
-        number = 0;
+static void append_number(QString& out, int32_t number)
+{
+    char buf[12];
+    int pos = sizeof(buf);
+    uint32_t n = number < 0 ? 0u - uint32_t(number) : uint32_t(number);
 
-    return number;
+    do {
+        buf[--pos] = char('0' + n % 10);
+        n /= 10;
+    } while (n);
+    if (number < 0)
+        buf[--pos] = '-';
+    out.append(QLatin1String(buf + pos, int(sizeof(buf)) - pos));
 }
 
-QString time_format(int32_t ms)
+static void append_two_digits(QString& out, int number)
+{
+    out.append(QChar('0' + number / 10));
+    out.append(QChar('0' + number % 10));
+}
+
+/* Same result as QTime::toString() with "h:mm:ss" or "m:ss" */
+static void append_time(QString& out, int32_t ms)
 {
     int secs = (ms / 1000) % 60;
     int minute = (ms / 1000) / 60 % 60;
     int hour = (ms / 1000) / 60 / 60 % 60;
-    QTime t(hour, minute, secs);
 
-    return t.toString(hour > 0 ? "h:mm:ss" : "m:ss");
+    if (secs < 0 || minute < 0 || hour < 0 || hour > 23)
+        return; /* Not a valid QTime, which is formatted as an empty string */
+
+    if (hour > 0) {
+        append_number(out, hour);
+        out.append(QLatin1Char(':'));
+        append_two_digits(out, minute);
+    } else {
+        append_number(out, minute);
+    }
+    out.append(QLatin1Char(':'));
+    append_two_digits(out, secs);
+}
+
+/* Specifier kinds, the table points directly at their append functions */
+struct string_value {
+    static constexpr bool cached = false;
+    static void append(QString& out, const song& s, char id) { out.append(s.get_string_value(id)); }
+};
+
+struct int_value {
+    static constexpr bool cached = true;
+    static void append(QString& out, const song& s, char id) { append_number(out, s.get_int_value(id)); }
+};
+
+struct time_value {
+    static constexpr bool cached = true;
+    static void append(QString& out, const song& s, char id) { append_time(out, s.get_int_value(id)); }
+};
+
+struct artist_list {
+    static constexpr bool cached = true;
+    static void append(QString& out, const song& s, char id)
+    {
+        UNUSED_PARAMETER(id);
+        const auto& artists = s.artists();
+        if (artists.isEmpty()) {
+            out.append(QLatin1String("n/a"));
+            return;
+        }
+
+        for (int i = 0; i < artists.size(); i++) {
+            if (i > 0)
+                out.append(QLatin1String(", "));
+            out.append(artists[i]);
+        }
+    }
+};
+
+struct release_year {
+    static constexpr bool cached = false;
+    static void append(QString& out, const song& s, char id)
+    {
+        UNUSED_PARAMETER(id);
+        if (s.year())
+            append_number(out, s.year());
+    }
+};
+
+struct release_date {
+    static constexpr bool cached = true;
+    static void append(QString& out, const song& s, char id)
+    {
+        release_year::append(out, s, id);
+        if (s.release_precision() == prec_day) {
+            out.append(QLatin1Char('.'));
+            append_two_digits(out, s.month());
+            out.append(QLatin1Char('.'));
+            append_two_digits(out, s.day());
+        } else if (s.release_precision() == prec_month) {
+            out.append(QLatin1Char('.'));
+            append_two_digits(out, s.month());
+            out.append(QLatin1Char('.'));
+        }
+    }
+};
+
+template<char C> struct static_char {
+    static constexpr bool cached = false;
+    static void append(QString& out, const song& s, char id)
+    {
+        UNUSED_PARAMETER(s);
+        UNUSED_PARAMETER(id);
+        out.append(QLatin1Char(C));
+    }
+};
+
+template<class T> static void add(char id, int tag_id = 0)
+{
+    auto& sp = specifiers[int(id)];
+    sp.append = &T::append;
+    sp.id = id;
+    sp.tag_id = tag_id;
+    sp.cached = T::cached;
 }
 
 void init()
 {
     /* Register format specifiers with their data */
-    specifiers.emplace_back(std::make_unique<specifier_string>('t', CAP_TITLE));
-    specifiers.emplace_back(std::make_unique<specifier_string>('a', CAP_ALBUM));
-    specifiers.emplace_back(std::make_unique<specifier_string>('y', CAP_RELEASE));
-    specifiers.emplace_back(std::make_unique<specifier_string>('b', CAP_LABEL));
-    specifiers.emplace_back(std::make_unique<specifier_string_list>('m', CAP_ARTIST));
-    specifiers.emplace_back(std::make_unique<specifier_date>('r', CAP_RELEASE));
-    specifiers.emplace_back(std::make_unique<specifier_int>('d', CAP_DISC_NUMBER));
-    specifiers.emplace_back(std::make_unique<specifier_int>('n', CAP_TRACK_NUMBER));
-    specifiers.emplace_back(std::make_unique<specifier_time>('p', CAP_PROGRESS));
-    specifiers.emplace_back(std::make_unique<specifier_time>('l', CAP_DURATION));
-    specifiers.emplace_back(std::make_unique<specifier_static>('e', "\n"));
-    specifiers.emplace_back(std::make_unique<specifier_static>('s', " "));
-}
-
-void execute(QString& q)
-{
-    auto splits = q.split("%");
-    auto src_ref = music_sources::selected_source();
-    bool first = !q.startsWith("%");
-    for (auto& split : splits) {
+    add<string_value>('t', CAP_TITLE);
+    add<string_value>('a', CAP_ALBUM);
+    add<release_year>('y', CAP_RELEASE);
+    add<string_value>('b', CAP_LABEL);
+    add<artist_list>('m', CAP_ARTIST);
+    add<release_date>('r', CAP_RELEASE);
+    add<int_value>('d', CAP_DISC_NUMBER);
+    add<int_value>('n', CAP_TRACK_NUMBER);
+    add<time_value>('p', CAP_PROGRESS);
+    add<time_value>('l', CAP_DURATION);
+    add<static_char<'\n'>>('e');
+    add<static_char<' '>>('s');
+}
+
+void execute(QString& out, const song& s)
+{
+    const compiled_format f(out);
+    out.clear();
+    f.execute(out, s);
+}
+
+/* A %( %| %) section that is still being parsed */
+struct open_section {
+    size_t branch; /* The branch token of the current branch */
+    std::vector<size_t> jumps; /* Jumps at the end of the previous branches */
+};
+
+static void add_branch(std::vector<token>& tokens, const QString& text)
+{
+    token t;
+    t.type = TOKEN_BRANCH;
+    t.text = text;
+    tokens.push_back(t);
+}
+
+/* Points the last branch and all jumps behind the section, where the
+ * text following %) continues */
+static void close_section(std::vector<token>& tokens, const open_section& section, const QString& text)
+{
+    const auto end = tokens.size();
+    tokens[section.branch].jump = end;
+    for (const auto j : section.jumps)
+        tokens[j].jump = end;
+
+    token t;
+    t.text = text;
+    tokens.push_back(t);
+}
+
+compiled_format::compiled_format(const QString& format)
+    : m_source(format)
+{
+    std::vector<open_section> sections;
+    const auto splits = format.split("%");
+    bool first = !format.startsWith("%");
+    for (const auto& split : splits) {
         if (first) {
             first = false;
+            append_text(split);
             continue;
         }
 
         if (split.isEmpty())
             continue;
 
-        auto sp = get_matching_specifier(split[0].toLower().toLatin1());
-        if (sp)
-            sp->do_format(split, src_ref->song_info());
-    }
-    src_ref.reset();
-    q = splits.join("");
-}
+        const auto c = split[0];
+        if (c == '(') {
+            sections.push_back({ m_tokens.size(), {} });
+            add_branch(m_tokens, split.mid(1));
+            continue;
+        }
 
-bool specifier::replace(QString& slice, const song& s, const QString& data) const
-{
-    if (!(s.data() & m_tag_id))
-        return false; /* We do not have the information needed for this specifier */
+        /* Outside of a section these are just text like other unknown specifiers */
+        if (c == '|' && !sections.empty()) {
+            auto& section = sections.back();
+            token j;
+            j.type = TOKEN_JUMP;
+            section.jumps.push_back(m_tokens.size());
+            m_tokens.push_back(j);
 
-    /* get truncation, if specified */
-    int max_length = get_truncate_arg(slice);
-    QString copy = data;
-    if (slice[0].isUpper())
-        copy = copy.toUpper();
-    if (max_length > 0 && copy.length() > max_length) {
-        copy.truncate(max_length);
-        copy.append("...");
-    }
-    slice = slice.remove(0, 1);
-    slice.prepend(copy);
+            m_tokens[section.branch].jump = m_tokens.size();
+            section.branch = m_tokens.size();
+            add_branch(m_tokens, split.mid(1));
+            continue;
+        }
 
-    return true;
-}
+        if (c == ')' && !sections.empty()) {
+            close_section(m_tokens, sections.back(), split.mid(1));
+            sections.pop_back();
+            continue;
+        }
 
-bool specifier::do_format(QString& slice, const song& s) const
-{
-    return replace(slice, s);
-}
+        auto sp = get_matching_specifier(c.toLower().toLatin1());
+        if (!sp) {
+            append_text(split);
+            continue;
+        }
 
-bool specifier_string::do_format(QString& slice, const song& s) const
-{
-    return replace(slice, s, s.get_string_value(m_id));
+        token t;
+        int consumed = 1;
+        t.type = TOKEN_VALUE;
+        t.spec = sp;
+        m_fields |= sp->tag_id;
+        /* Only specifiers directly in a branch decide whether it's taken,
+         * ones in nested sections are optional */
+        if (!sections.empty())
+            m_tokens[sections.back().branch].required |= sp->tag_id;
+        if (sp->tag_id) {
+            t.upper = split[0].isUpper();
+            t.max_length = get_truncate_arg(split, consumed);
+        }
+        t.fallback = split.left(consumed);
+        t.text = split.mid(consumed);
+        m_tokens.push_back(t);
+    }
+
+    /* Sections that weren't closed end with the format */
+    while (!sections.empty()) {
+        close_section(m_tokens, sections.back(), QString());
+        sections.pop_back();
+    }
 }
 
-bool specifier_static::do_format(QString& slice, const song& s) const
+void compiled_format::append_text(const QString& text)
 {
-    UNUSED_PARAMETER(s);
-    slice = slice.remove(0, 1);
-    slice.prepend(m_static_value);
-    return true;
+    if (m_tokens.empty())
+        m_tokens.emplace_back();
+    m_tokens.back().text.append(text);
 }
 
-bool specifier_time::do_format(QString& slice, const song& s) const
+static void to_upper(QString& str, int start)
 {
-    QString value = time_format(s.get_int_value(m_id));
-    return replace(slice, s, value);
+    QChar* data = str.data();
+    for (int i = start; i < str.size(); i++)
+        data[i] = data[i].toUpper();
 }
 
-bool specifier_int::do_format(QString& slice, const song& s) const
+const QString& value_cache::get(const song& s, const specifier& sp, bool upper)
 {
-    QString value = QString::number(s.get_int_value(m_id));
-    return replace(slice, s, value);
+    const int id = sp.id;
+    if (!m_valid[id]) {
+        m_values[id].truncate(0);
+        sp.append(m_values[id], s, sp.id);
+        m_valid.set(id);
+    }
+    if (!upper)
+        return m_values[id];
+
+    if (!m_upper_valid[id]) {
+        /* Copy the characters, sharing the string would make the next
+         * reset() allocate */
+        auto& value = m_upper[id];
+        value.truncate(0);
+        value.append(m_values[id].constData(), m_values[id].size());
+        to_upper(value, 0);
+        m_upper_valid.set(id);
+    }
+    return m_upper[id];
 }
 
-bool specifier_string_list::do_format(QString& slice, const song& s) const
+static void append_value(QString& out, const song& s, const token& t, value_cache* cache)
 {
-    QString concatenated_list;
-    concatenated_list = s.artists().join(", ");
+    const auto tag = t.spec->tag_id;
+    if (tag && !(s.data() & tag)) {
+        /* We do not have the information needed for this specifier */
+        out.append(t.fallback);
+        return;
+    }
 
-    if (concatenated_list.isEmpty())
-        concatenated_list = "n/a";
-    return replace(slice, s, concatenated_list);
+    /* Modify the value in place after appending it */
+    const int start = out.size();
+    if (cache && (t.spec->cached || t.upper)) {
+        const auto& value = cache->get(s, *t.spec, t.upper);
+        out.append(value.constData(), value.size());
+    } else {
+        t.spec->append(out, s, t.spec->id);
+        if (t.upper)
+            to_upper(out, start);
+    }
+    if (t.max_length > 0 && out.size() - start > t.max_length) {
+        out.truncate(start + t.max_length);
+        out.append(QLatin1String("..."));
+    }
 }
 
-bool specifier_date::do_format(QString& slice, const song& s) const
+void compiled_format::execute(QString& out, const song& s, value_cache* cache) const
 {
-    QString data;
-    if (s.release_precision() == prec_day) {
-        data.append(s.year()).append(".").append(s.month()).append(".").append(s.day());
-    } else if (s.release_precision() == prec_month) {
-        data.append(s.year()).append(".").append(s.month()).append(".");
-    } else {
-        data.append(s.year());
+    size_t i = 0;
+    while (i < m_tokens.size()) {
+        const auto& t = m_tokens[i];
+        switch (t.type) {
+        case TOKEN_BRANCH:
+            if ((s.data() & t.required) != t.required) {
+                /* Skip the whole branch without formatting anything in it */
+                i = t.jump;
+                continue;
+            }
+            break;
+        case TOKEN_JUMP:
+            i = t.jump;
+            continue;
+        case TOKEN_VALUE:
+            append_value(out, s, t, cache);
+            break;
+        default:;
+        }
+        out.append(t.text);
+        i++;
     }
-    return replace(slice, s, data);
 }
 
 }
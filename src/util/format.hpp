@@ -18,99 +18,110 @@
 
 #pragma once
 #include <QString>
+#include <bitset>
+#include <stdint.h>
 #include <vector>
 
+/* Specifiers are ASCII characters */
+#define SPECIFIER_COUNT 128
+
 class song;
-class specifier;
 
 namespace format {
 
-void init();
-void execute(QString& out);
-
-class specifier {
-protected:
-    char m_id;
-    int m_tag_id;
-
-public:
-    virtual ~specifier() = default;
-    specifier() = default;
-    specifier(char id, int tag_id)
-        : m_id(id)
-        , m_tag_id(tag_id)
-    {
-    }
-
-    virtual bool do_format(QString& slice, const song& s) const;
-    bool replace(QString& slice, const song& s, const QString& data = "") const;
-
-    char get_id() const { return m_id; }
-};
-
-class specifier_time : public specifier {
-public:
-    specifier_time(char id, int tag_id)
-        : specifier(id, tag_id)
-    {
-    }
-
-    bool do_format(QString& slice, const song& s) const override;
+/* Appends the value of the specifier id (always lower case) */
+typedef void (*append_func)(QString& out, const song& s, char id);
+
+/* Entry in the specifier table, which is indexed by the specifier character */
+struct specifier {
+    append_func append = nullptr;
+    char id = 0;
+    /* Zero for specifiers that don't depend on song info, which
+     * also can't be truncated or upper cased */
+    int tag_id = 0;
+    /* Worth keeping in a value_cache, because the value has to be built
+     * first instead of just being copied from the song */
+    bool cached = false;
 };
 
-class specifier_int : public specifier {
-public:
-    specifier_int(char id, int tag_id)
-        : specifier(id, tag_id)
-    {
-    }
+void init();
 
-    bool do_format(QString& slice, const song& s) const override;
+/* Compiles the format and runs it once, for formats that aren't reused */
+void execute(QString& out, const song& s);
+
+enum token_type {
+    TOKEN_TEXT,
+    TOKEN_VALUE,
+    /* Start of a branch of a %( %| %) section, which is skipped by jumping
+     * to the next branch if the song is missing some of the info it uses */
+    TOKEN_BRANCH,
+    /* End of a branch that was taken, jumps behind the section */
+    TOKEN_JUMP
 };
 
-class specifier_string : public specifier {
-public:
-    specifier_string(char id, int tag_id)
-        : specifier(id, tag_id)
-    {
-    }
-
-    bool do_format(QString& slice, const song& s) const override;
+/* A specifier, plain text or section marker with the plain text that follows it */
+struct token {
+    token_type type = TOKEN_TEXT;
+    const specifier* spec = nullptr; /* Only set for TOKEN_VALUE */
+    QString text;
+    /* CAP_* flags a branch needs to be taken */
+    uint32_t required = 0;
+    /* Index of the token to continue at for branches and jumps */
+    size_t jump = 0;
+    /* Written instead of the value if the song doesn't have the information,
+     * which is the specifier as it was written minus the '%' */
+    QString fallback;
+    int max_length = 0;
+    bool upper = false;
 };
 
-class specifier_static : public specifier {
-    QString m_static_value;
+/* Values of specifiers for one song, shared between all outputs that are
+ * formatted for it, so things like the artist list, times or upper cased
+ * values are only built once per refresh. Values keep their capacity
+ * between songs */
+class value_cache {
+    QString m_values[SPECIFIER_COUNT];
+    QString m_upper[SPECIFIER_COUNT];
+    std::bitset<SPECIFIER_COUNT> m_valid, m_upper_valid;
 
 public:
-    specifier_static(char id, const QString& value)
-        : specifier(id, 0)
-        , m_static_value(value)
+    /* Has to be called before formatting a different song */
+    void reset()
     {
+        m_valid.reset();
+        m_upper_valid.reset();
     }
 
-    bool do_format(QString& slice, const song& s) const override;
+    const QString& get(const song& s, const specifier& sp, bool upper);
 };
 
-class specifier_string_list : public specifier {
-    const QList<QString>* m_data;
+/* A format string that was split into tokens once, so it doesn't have to be
+ * parsed again every time a song is formatted.
+ * %( ... %| ... %) is a section that shows the first branch for which the
+ * song has all info used directly in it and nothing if there's none, e.g.
+ * "%t%( - %a%)" or "%(%m%|Unknown artist%)". Branches that aren't shown
+ * aren't formatted at all */
+class compiled_format {
+    QString m_source;
+    std::vector<token> m_tokens;
+    uint32_t m_fields = 0;
+
+    void append_text(const QString& text);
 
 public:
-    specifier_string_list(char id, int tag_id)
-        : specifier(id, tag_id)
-    {
-    }
+    compiled_format() = default;
+    explicit compiled_format(const QString& format);
 
-    bool do_format(QString& slice, const song& s) const override;
-};
+    /* The format string this was compiled from */
+    const QString& source() const { return m_source; }
 
-class specifier_date : public specifier {
-public:
-    specifier_date(char id, int tag_id)
-        : specifier(id, tag_id)
-    {
-    }
+    /* CAP_* flags of all song info used by this format */
+    uint32_t fields() const { return m_fields; }
 
-    bool do_format(QString& slice, const song& s) const override;
+    /* Appends the formatted song info to out. If out has enough capacity
+     * this doesn't allocate. With a cache, values are taken from and added
+     * to it */
+    void execute(QString& out, const song& s, value_cache* cache = nullptr) const;
 };
 
 }
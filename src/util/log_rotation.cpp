@@ -0,0 +1,170 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "log_rotation.hpp"
+#include "utility.hpp"
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <util/platform.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* Size of the chunks segments are compressed in */
+#define CHUNK_SIZE (64 * 1024)
+
+namespace log_rotation {
+
+static std::mutex queue_mutex;
+static std::condition_variable queue_cv;
+static std::deque<segment> queue;
+static std::thread worker;
+static bool running = false;
+static bool closing = false;
+
+#if HAVE_ZLIB
+/* Streams the segment into <segment>.gz, which only appears once it's complete */
+static bool compress(const QString& path, const QString& target)
+{
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly))
+        return false;
+
+    const QString tmp_path = target + ".tmp";
+#ifdef _WIN32
+    gzFile out = gzopen_w(reinterpret_cast<const wchar_t*>(tmp_path.utf16()), "wb");
+#else
+    gzFile out = gzopen(qt_to_utf8(tmp_path), "wb");
+#endif
+    if (!out)
+        return false;
+
+    bool success = true;
+    QByteArray chunk(CHUNK_SIZE, 0);
+    for (;;) {
+        const auto read = in.read(chunk.data(), CHUNK_SIZE);
+        if (read < 0) {
+            success = false;
+            break;
+        }
+        if (read == 0)
+            break;
+        if (gzwrite(out, chunk.constData(), unsigned(read)) != int(read)) {
+            success = false;
+            break;
+        }
+    }
+
+    success = gzclose(out) == Z_OK && success;
+    success = success && os_rename(qt_to_utf8(tmp_path), qt_to_utf8(target)) == 0;
+    if (!success)
+        QFile::remove(tmp_path);
+    return success;
+}
+#endif
+
+static void finish(const segment& s)
+{
+    const auto size = QFileInfo(s.path).size();
+    QString file = s.path;
+
+#if HAVE_ZLIB
+    const auto compressed = s.path + ".gz";
+    if (compress(s.path, compressed)) {
+        QFile::remove(s.path);
+        file = compressed;
+    } else {
+        bwarn("Couldn't compress log segment %s, keeping it uncompressed", qt_to_utf8(s.path));
+    }
+#endif
+
+    /* The index sits next to the log, so only the file name is stored */
+    QJsonObject entry;
+    entry["segment"] = QFileInfo(file).fileName();
+    entry["start"] = double(s.started);
+    entry["end"] = double(s.ended);
+    entry["size"] = double(size);
+    entry["compressed"] = file != s.path;
+
+    QFile index(s.log_path + ".index");
+    if (index.open(QIODevice::WriteOnly | QIODevice::Append))
+        index.write(QJsonDocument(entry).toJson(QJsonDocument::Compact).append('\n'));
+    else
+        berr("Couldn't open log index %s", qt_to_utf8(index.fileName()));
+}
+
+static void worker_method()
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    for (;;) {
+        queue_cv.wait(lock, [] { return !queue.empty() || closing; });
+        if (queue.empty())
+            break;
+        const auto s = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        finish(s);
+        lock.lock();
+    }
+}
+
+void start()
+{
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (running)
+        return;
+    closing = false;
+    running = true;
+    worker = std::thread(worker_method);
+}
+
+void stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!running)
+            return;
+        closing = true;
+    }
+    queue_cv.notify_one();
+    worker.join();
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    running = false;
+}
+
+void push(const segment& s)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if (!running) {
+        lock.unlock();
+        finish(s);
+        return;
+    }
+    queue.push_back(s);
+    lock.unlock();
+    queue_cv.notify_one();
+}
+
+}
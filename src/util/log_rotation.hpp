@@ -0,0 +1,44 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <QString>
+#include <stdint.h>
+
+/* Log outputs that reached their rotation limit are moved into segments,
+ * which are compressed with gzip on a background thread if zlib was found
+ * at build time. Every finished segment is added as a line of JSON to
+ * <log>.index, so the newest segment is always the last line */
+namespace log_rotation {
+
+struct segment {
+    QString log_path; /* The log output */
+    QString path; /* Where the log was moved to */
+    int64_t started; /* Unix time stamps of when the segment was started and rotated */
+    int64_t ended;
+};
+
+void start();
+
+/* Finishes all queued segments */
+void stop();
+
+/* While the rotation thread isn't running the segment is finished right away */
+void push(const segment& s);
+
+}
@@ -0,0 +1,241 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "log_writer.hpp"
+#include "config.hpp"
+#include "log_rotation.hpp"
+#include "utility.hpp"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <util/platform.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+/* Buffers are written once they're this large, even if
+ * the flush interval isn't over yet */
+#define LOG_BUFFER_SIZE 4096
+
+#ifdef _WIN32
+#define LOG_NEWLINE "\r\n"
+#else
+#define LOG_NEWLINE "\n"
+#endif
+
+namespace log_writer {
+
+struct log_file {
+    QFile file;
+    QByteArray buffer;
+    uint64_t first_pending = 0; /* When the oldest buffered line was added */
+    rotation limits;
+    int64_t size = 0; /* Of the open file */
+    int64_t started_at = 0; /* Start of the current segment as a unix time stamp, zero until it's known */
+};
+
+/* The write stage appends and flushes, stopping the pipeline closes */
+static std::mutex files_mutex;
+static QHash<QString, std::shared_ptr<log_file>> files;
+
+/* Log rotation renames or deletes the file, after which the open
+ * handle would still write into the old one */
+static bool rotated(const log_file& f)
+{
+#ifdef _WIN32
+    /* Files that are open can't be renamed, but they can be deleted */
+    return !QFile::exists(f.file.fileName());
+#else
+    struct stat disk, handle;
+    if (stat(qt_to_utf8(f.file.fileName()), &disk) != 0 || fstat(f.file.handle(), &handle) != 0)
+        return true;
+    return disk.st_dev != handle.st_dev || disk.st_ino != handle.st_ino;
+#endif
+}
+
+/* Logs are opened again every time OBS or the pipeline starts, so the
+ * start of a segment that already has lines comes from disk: the end of
+ * the last segment in the index or when the file was created */
+static int64_t segment_start(const QString& path)
+{
+    const QFileInfo info(path);
+    if (!info.exists() || info.size() == 0)
+        return util::epoch();
+
+    QFile index(path + ".index");
+    if (index.open(QIODevice::ReadOnly)) {
+        /* Only the last entry is needed */
+        index.seek(std::max<int64_t>(0, index.size() - 4096));
+        const auto lines = index.readAll().split('\n');
+        for (auto it = lines.crbegin(); it != lines.crend(); ++it) {
+            const auto entry = QJsonDocument::fromJson(*it).object();
+            if (entry.contains("end"))
+                return int64_t(entry["end"].toDouble());
+        }
+    }
+
+    const auto created = info.birthTime();
+    return created.isValid() ? created.toSecsSinceEpoch() : util::epoch();
+}
+
+static bool open(log_file& f)
+{
+    if (!f.started_at)
+        f.started_at = segment_start(f.file.fileName());
+    if (!f.file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    f.size = f.file.size();
+    return true;
+}
+
+/* Segments are named after the time they were moved, with a counter
+ * for logs that are rotated more than once in the same millisecond */
+static QString segment_name(const QString& path)
+{
+    const auto base = path + "." + QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss-zzz");
+    auto segment = base;
+    for (int i = 1; QFile::exists(segment) || QFile::exists(segment + ".gz"); i++)
+        segment = base + "-" + QString::number(i);
+    return segment;
+}
+
+/* Moves the log into a new segment, which is then compressed in the background */
+static void rotate(log_file& f)
+{
+    const auto path = f.file.fileName();
+    const auto now = util::epoch();
+    const auto segment = segment_name(path);
+    f.file.close();
+    if (os_rename(qt_to_utf8(path), qt_to_utf8(segment)) != 0) {
+        berr("Couldn't move log output %s to %s", qt_to_utf8(path), qt_to_utf8(segment));
+        return;
+    }
+    log_rotation::push({ path, segment, f.started_at, now });
+    /* The next segment starts once the log is opened again */
+    f.started_at = 0;
+}
+
+static bool rotation_due(const log_file& f)
+{
+    if (f.limits.max_kb && f.size >= int64_t(f.limits.max_kb) * 1024)
+        return true;
+    return f.limits.max_minutes && f.started_at && util::epoch() - f.started_at >= int64_t(f.limits.max_minutes) * 60;
+}
+
+static void write_out(log_file& f)
+{
+    if (f.buffer.isEmpty())
+        return;
+
+    if (f.file.isOpen() && rotated(f)) {
+        f.file.close();
+        f.started_at = 0;
+    }
+    if (!f.file.isOpen() && !open(f)) {
+        berr("Couldn't open song output file %s", qt_to_utf8(f.file.fileName()));
+    } else if (f.file.write(f.buffer) != f.buffer.size() || !f.file.flush()) {
+        berr("Couldn't write to song output file %s", qt_to_utf8(f.file.fileName()));
+    } else {
+        f.size += f.buffer.size();
+        if (config::sync_logs && !util::sync_file(f.file))
+            bwarn("Couldn't sync song output file %s", qt_to_utf8(f.file.fileName()));
+        if (rotation_due(f))
+            rotate(f);
+    }
+
+    /* Lines that couldn't be written are dropped, like before they were buffered.
+     * resize() keeps the capacity */
+    f.buffer.resize(0);
+    f.first_pending = 0;
+}
+
+void append(const QString& path, const QString& line, const rotation& r)
+{
+    std::lock_guard<std::mutex> lock(files_mutex);
+    auto& f = files[path];
+    if (!f) {
+        f = std::make_shared<log_file>();
+        f->file.setFileName(path);
+    }
+    f->limits = r;
+
+    if (f->buffer.isEmpty())
+        f->first_pending = os_gettime_ns();
+    auto text = line.toUtf8();
+#ifdef _WIN32
+    /* The file isn't opened in text mode, so line breaks
+     * in the line itself (e.g. from %e) are converted here */
+    if (text.contains('\n'))
+        text.replace("\r\n", "\n").replace("\n", LOG_NEWLINE);
+#endif
+    f->buffer.append(text).append(LOG_NEWLINE);
+    if (!config::log_flush_interval || f->buffer.size() >= LOG_BUFFER_SIZE)
+        write_out(*f);
+}
+
+int64_t flush_due()
+{
+    std::lock_guard<std::mutex> lock(files_mutex);
+    const uint64_t now = os_gettime_ns();
+    const uint64_t interval = uint64_t(config::log_flush_interval) * 1000000;
+    int64_t next = -1;
+
+    for (auto& f : files) {
+        /* Logs that aren't written to anymore are rotated on time too */
+        if (f->file.isOpen() && f->limits.max_minutes && f->started_at) {
+            if (rotation_due(*f)) {
+                rotate(*f);
+            } else {
+                const auto left = f->started_at + int64_t(f->limits.max_minutes) * 60 - util::epoch();
+                const auto due = left * 1000;
+                if (next < 0 || due < next)
+                    next = due;
+            }
+        }
+
+        if (f->buffer.isEmpty())
+            continue;
+        const uint64_t waited = now - f->first_pending;
+        if (waited >= interval) {
+            write_out(*f);
+            continue;
+        }
+        const auto due = int64_t((interval - waited) / 1000000) + 1;
+        if (next < 0 || due < next)
+            next = due;
+    }
+    return next;
+}
+
+void close_all()
+{
+    std::lock_guard<std::mutex> lock(files_mutex);
+    for (auto& f : files) {
+        write_out(*f);
+        f->file.close();
+    }
+    files.clear();
+}
+
+}
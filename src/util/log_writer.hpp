@@ -0,0 +1,48 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <QString>
+#include <stdint.h>
+
+/* Log outputs are kept open and lines are collected in a buffer per file,
+ * which is written once it's large enough or has waited long enough, so
+ * long sessions don't open and close every log file for every song.
+ * If a log file is renamed or deleted by log rotation, it's opened again
+ * on the next write. Log outputs with a rotation limit are moved into a
+ * segment once they reach it, see log_rotation.hpp */
+namespace log_writer {
+
+/* When a log output is moved into a segment, zero disables a limit.
+ * Set per output in outputs.json */
+struct rotation {
+    uint32_t max_kb = 0;
+    uint32_t max_minutes = 0;
+};
+
+void append(const QString& path, const QString& line, const rotation& r = {});
+
+/* Writes buffers that have waited for the flush interval and rotates logs
+ * that are due. Returns how many ms until the next buffer or rotation is
+ * due or -1 if there's nothing to wait for */
+int64_t flush_due();
+
+/* Writes all buffers and closes all files */
+void close_all();
+
+}
@@ -0,0 +1,115 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <utility>
+
+/* Single slot queue between two threads. If the consumer hasn't picked
+ * up the last value yet, a new value is merged into it (by default it just
+ * replaces it), so a slow consumer never holds up the producer and only
+ * ever sees the latest state */
+template<class T> class mailbox {
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    T m_value {};
+    bool m_full = false;
+    bool m_closed = false;
+    uint64_t m_coalesced = 0;
+
+public:
+    template<class Merge> void push(T value, Merge merge)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed)
+                return;
+            if (m_full) {
+                merge(m_value, std::move(value));
+                m_coalesced++;
+            } else {
+                m_value = std::move(value);
+                m_full = true;
+            }
+        }
+        m_cv.notify_one();
+    }
+
+    void push(T value)
+    {
+        push(std::move(value), [](T& pending, T&& latest) { pending = std::move(latest); });
+    }
+
+    /* Blocks until there's a value or the mailbox was closed. A value that
+     * was pushed before closing is still handed out, so false means that
+     * the mailbox is closed and empty */
+    bool pop(T& out)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_full || m_closed; });
+        if (!m_full)
+            return false;
+        out = std::move(m_value);
+        m_value = T();
+        m_full = false;
+        return true;
+    }
+
+    /* Like pop(), but gives up after timeout_ms. Returns false if the
+     * mailbox is closed and empty, timed_out is set if it's still open */
+    bool pop_for(T& out, uint32_t timeout_ms, bool& timed_out)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        timed_out = !m_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return m_full || m_closed; });
+        if (!m_full)
+            return false;
+        out = std::move(m_value);
+        m_value = T();
+        m_full = false;
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_cv.notify_all();
+    }
+
+    void open()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_value = T();
+        m_full = false;
+        m_closed = false;
+        m_coalesced = 0;
+    }
+
+    /* How many values were merged into a pending value instead
+     * of being picked up on their own */
+    uint64_t coalesced()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_coalesced;
+    }
+};
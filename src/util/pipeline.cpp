@@ -0,0 +1,366 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+
+#include "pipeline.hpp"
+#include "../query/song.hpp"
+#include "log_rotation.hpp"
+#include "log_writer.hpp"
+#include "mailbox.hpp"
+#include "utility.hpp"
+#include <QHash>
+#include <QList>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <util/platform.h>
+
+/* Upper limit for queued cover tasks and for log lines
+ * waiting to be written, the oldest ones are dropped first */
+#define MAX_COVER_TASKS 32
+#define MAX_PENDING_WRITES 256
+
+/* Writes that took longer than this from being queued to being done
+ * are reported, since they mean outputs lag behind the song */
+#define WRITE_LATENCY_WARN_MS 1000
+#define STOP_FLUSH_TIMEOUT_MS 2000
+/* How often the write stats are logged while outputs are written */
+#define WRITE_STATS_INTERVAL_NS (10ull * 60 * 1000000000)
+
+namespace pipeline {
+
+struct cover_task {
+    std::function<void()> run;
+    bool download;
+};
+
+static std::mutex state_mutex;
+static bool running = false;
+static std::thread format_thread, write_thread, cover_thread;
+
+/* Writes waiting for the write stage. Outputs have one slot per file,
+ * so only their latest text is written, log lines are all kept */
+struct write_batch {
+    QList<util::output_write> writes;
+    QHash<QString, int> slots; /* Index of the pending write for a file */
+    uint64_t seq = 0; /* Sequence number of the newest merged batch */
+    uint64_t queued_at = 0; /* When the oldest write was queued */
+};
+
+static mailbox<std::shared_ptr<const song>> songs;
+static mailbox<write_batch> writes;
+
+/* Guards the write stats and sequence numbers */
+static std::mutex stats_mutex;
+static std::condition_variable flushed_cv;
+static write_stats stats;
+static uint64_t queued_seq = 0, written_seq = 0;
+/* Once set, writes that are still pending after this time are abandoned */
+static std::atomic<uint64_t> write_deadline { 0 };
+
+static std::mutex cover_mutex;
+static std::condition_variable cover_cv;
+static std::deque<cover_task> cover_tasks;
+static bool cover_running = false;
+static bool cover_closing = false;
+
+static void index_slots(write_batch& batch)
+{
+    batch.slots.clear();
+    for (int i = 0; i < batch.writes.size(); i++) {
+        if (!batch.writes[i].log_mode)
+            batch.slots.insert(batch.writes[i].path, i);
+    }
+}
+
+/* Writes to the same file replace each other, except for logs where
+ * every line has to end up in the file */
+static void merge_writes(write_batch& pending, write_batch&& latest)
+{
+    uint64_t coalesced = 0, dropped = 0;
+    for (auto& w : latest.writes) {
+        const auto it = w.log_mode ? pending.slots.constEnd() : pending.slots.constFind(w.path);
+        if (it != pending.slots.constEnd()) {
+            pending.writes[it.value()] = std::move(w);
+            coalesced++;
+        } else {
+            if (!w.log_mode)
+                pending.slots.insert(w.path, pending.writes.size());
+            pending.writes.append(std::move(w));
+        }
+    }
+    pending.seq = latest.seq;
+
+    /* Only the oldest log lines can go, every slot output keeps its latest write */
+    if (pending.writes.size() > MAX_PENDING_WRITES) {
+        auto excess = pending.writes.size() - MAX_PENDING_WRITES;
+        for (auto it = pending.writes.begin(); excess > 0 && it != pending.writes.end();) {
+            if (it->log_mode) {
+                it = pending.writes.erase(it);
+                excess--;
+                dropped++;
+            } else {
+                ++it;
+            }
+        }
+        if (dropped) {
+            bwarn("Output writes are falling behind, dropping %i log lines", int(dropped));
+            index_slots(pending);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.coalesced += coalesced;
+    stats.dropped += dropped;
+    stats.max_pending = std::max(stats.max_pending, uint64_t(pending.writes.size()));
+}
+
+static void queue_writes(QList<util::output_write>&& changed)
+{
+    write_batch batch;
+    batch.writes = std::move(changed);
+    batch.queued_at = os_gettime_ns();
+    index_slots(batch);
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.queued += batch.writes.size();
+        stats.max_pending = std::max(stats.max_pending, uint64_t(batch.writes.size()));
+        batch.seq = ++queued_seq;
+    }
+    writes.push(std::move(batch), merge_writes);
+}
+
+static void format_stage()
+{
+    std::shared_ptr<const song> s;
+    while (songs.pop(s)) {
+        QList<util::output_write> changed;
+        util::handle_outputs(*s, changed);
+        if (!changed.isEmpty())
+            queue_writes(std::move(changed));
+    }
+    /* Nothing left to format, so the writer can finish too */
+    writes.close();
+}
+
+/* Waits for the next batch, but wakes up in time to write buffered log lines */
+static bool next_batch(write_batch& batch)
+{
+    for (;;) {
+        const auto due = log_writer::flush_due();
+        if (due < 0)
+            return writes.pop(batch);
+
+        bool timed_out = false;
+        if (writes.pop_for(batch, uint32_t(due), timed_out))
+            return true;
+        if (!timed_out)
+            return false;
+    }
+}
+
+static void log_stats(const write_stats& s)
+{
+    binfo("Wrote %llu of %llu outputs, %llu were replaced by newer ones, %llu log lines were dropped and %llu "
+          "writes were abandoned (at most %llu waiting, %llu ms latency)",
+        static_cast<unsigned long long>(s.written), static_cast<unsigned long long>(s.queued),
+        static_cast<unsigned long long>(s.coalesced), static_cast<unsigned long long>(s.dropped),
+        static_cast<unsigned long long>(s.abandoned), static_cast<unsigned long long>(s.max_pending),
+        static_cast<unsigned long long>(s.max_latency_ms));
+}
+
+static void write_stage()
+{
+    write_batch batch;
+    uint64_t next_report = os_gettime_ns() + WRITE_STATS_INTERVAL_NS;
+    while (next_batch(batch)) {
+        uint64_t written = 0, abandoned = 0;
+        for (const auto& w : batch.writes) {
+            const auto deadline = write_deadline.load();
+            if (deadline && os_gettime_ns() >= deadline) {
+                abandoned = batch.writes.size() - written;
+                break;
+            }
+            util::write_song(w);
+            written++;
+        }
+
+        const auto now = os_gettime_ns();
+        const uint64_t latency_ms = (now - batch.queued_at) / 1000000;
+        if (latency_ms > WRITE_LATENCY_WARN_MS)
+            bwarn("Writing outputs took %llu ms", static_cast<unsigned long long>(latency_ms));
+        if (abandoned)
+            bwarn("Outputs took too long to write, abandoned %llu writes", static_cast<unsigned long long>(abandoned));
+
+        write_stats current;
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats.written += written;
+            stats.abandoned += abandoned;
+            stats.max_latency_ms = std::max(stats.max_latency_ms, latency_ms);
+            written_seq = batch.seq;
+            current = stats;
+        }
+        flushed_cv.notify_all();
+
+        if (now >= next_report) {
+            log_stats(current);
+            next_report = now + WRITE_STATS_INTERVAL_NS;
+        }
+    }
+}
+
+static void cover_stage()
+{
+    std::unique_lock<std::mutex> lock(cover_mutex);
+    for (;;) {
+        cover_cv.wait(lock, [] { return !cover_tasks.empty() || cover_closing; });
+        if (cover_tasks.empty())
+            break;
+        auto task = std::move(cover_tasks.front());
+        cover_tasks.pop_front();
+        lock.unlock();
+        task.run();
+        lock.lock();
+    }
+}
+
+void start()
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (running)
+        return;
+
+    songs.open();
+    writes.open();
+    {
+        std::lock_guard<std::mutex> stats_lock(stats_mutex);
+        stats = write_stats();
+        queued_seq = written_seq = 0;
+    }
+    write_deadline = 0;
+    {
+        std::lock_guard<std::mutex> cover_lock(cover_mutex);
+        cover_running = true;
+        cover_closing = false;
+    }
+
+    log_rotation::start();
+    format_thread = std::thread(format_stage);
+    write_thread = std::thread(write_stage);
+    cover_thread = std::thread(cover_stage);
+    running = true;
+}
+
+void stop()
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (!running)
+        return;
+
+    /* Each stage closes the next one once it's done */
+    songs.close();
+    format_thread.join();
+    /* Writes still pending after the timeout are abandoned, so only the
+     * write that is in progress can hold up the join */
+    write_deadline = os_gettime_ns() + uint64_t(STOP_FLUSH_TIMEOUT_MS) * 1000000;
+    if (!flush(STOP_FLUSH_TIMEOUT_MS))
+        bwarn("Outputs are still being written, abandoning the remaining writes");
+    write_thread.join();
+    log_writer::close_all();
+    /* Segments of logs that were rotated while closing are finished too */
+    log_rotation::stop();
+    log_stats(get_write_stats());
+
+    {
+        std::lock_guard<std::mutex> cover_lock(cover_mutex);
+        cover_closing = true;
+    }
+    cover_cv.notify_one();
+    cover_thread.join();
+
+    /* Tasks that were queued after the cover thread finished. They're run
+     * without the lock, a download shouldn't block other callers */
+    std::deque<cover_task> leftover;
+    {
+        std::lock_guard<std::mutex> cover_lock(cover_mutex);
+        leftover.swap(cover_tasks);
+        cover_running = false;
+    }
+    for (auto& task : leftover)
+        task.run();
+    running = false;
+}
+
+void push_song(std::shared_ptr<const song> s)
+{
+    std::unique_lock<std::mutex> lock(state_mutex);
+    if (running) {
+        lock.unlock();
+        songs.push(std::move(s));
+        return;
+    }
+
+    QList<util::output_write> changed;
+    util::handle_outputs(*s, changed);
+    for (const auto& w : changed)
+        util::write_song(w);
+    /* Without the write stage nothing would flush buffered log lines */
+    log_writer::close_all();
+}
+
+bool flush(uint32_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(stats_mutex);
+    const auto target = queued_seq;
+    return flushed_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [target] { return written_seq >= target; });
+}
+
+write_stats get_write_stats()
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return stats;
+}
+
+void push_cover(std::function<void()> task, bool download)
+{
+    std::unique_lock<std::mutex> lock(cover_mutex);
+    if (!cover_running) {
+        lock.unlock();
+        task();
+        return;
+    }
+
+    if (download && !cover_tasks.empty() && cover_tasks.back().download) {
+        cover_tasks.back().run = std::move(task);
+    } else {
+        if (cover_tasks.size() >= MAX_COVER_TASKS) {
+            bwarn("Cover tasks are falling behind, dropping the oldest one");
+            cover_tasks.pop_front();
+        }
+        cover_tasks.push_back({ std::move(task), download });
+    }
+    lock.unlock();
+    cover_cv.notify_one();
+}
+
+}
@@ -0,0 +1,67 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <functional>
+#include <memory>
+#include <stdint.h>
+
+class song;
+
+/* Song info goes through three stages, each on its own thread:
+ *   query (tuna thread) -> format (outputs) -> write (file I/O)
+ * and cover art is handled on a fourth thread. Stages are connected with
+ * single slot mailboxes, so a slow stage only ever gets the latest state
+ * and never holds up the stage before it.
+ * While the pipeline isn't running everything is done right away on the
+ * calling thread instead */
+namespace pipeline {
+
+void start();
+
+/* Processes everything that was queued so far and then stops all stages.
+ * Writes that aren't done within a few seconds are abandoned */
+void stop();
+
+/* Hands a song over to the format stage */
+void push_song(std::shared_ptr<const song> s);
+
+/* Waits until all writes that were queued before the call are done, for
+ * at most timeout_ms. Returns false if the writer didn't catch up in time */
+bool flush(uint32_t timeout_ms);
+
+/* Counters of the write stage since the pipeline was started, which are
+ * logged periodically and when the pipeline stops */
+struct write_stats {
+    uint64_t queued = 0; /* Writes handed over by the format stage */
+    uint64_t written = 0; /* Writes that actually went to disk */
+    uint64_t coalesced = 0; /* Writes replaced by a newer one for the same file */
+    uint64_t dropped = 0; /* Log lines dropped because the writer fell behind */
+    uint64_t abandoned = 0; /* Writes skipped because stopping took too long */
+    uint64_t max_pending = 0; /* Most writes that were waiting at once */
+    uint64_t max_latency_ms = 0; /* Longest time from queueing to being written */
+};
+
+write_stats get_write_stats();
+
+/* Runs a cover related task on the cover thread. Tasks are run in order,
+ * but a download replaces a download that was queued right before it,
+ * since only the latest cover matters */
+void push_cover(std::function<void()> task, bool download = false);
+
+}
@@ -0,0 +1,196 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "source_pool.hpp"
+#include "utility.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <util/platform.h>
+#include <vector>
+
+/* Every source gets its own worker, up to this many */
+#define MAX_WORKERS 4
+
+namespace source_pool {
+
+struct slot {
+    std::shared_ptr<music_source> src;
+    /* Held while the source is refreshed or runs a command */
+    std::mutex busy;
+    /* Everything below is guarded by pool_mutex */
+    std::shared_ptr<const song> latest;
+    uint64_t playing_since = 0;
+    bool queued = false;
+};
+
+static std::mutex pool_mutex;
+static std::condition_variable task_cv, done_cv;
+static std::deque<std::shared_ptr<slot>> tasks;
+static std::vector<std::shared_ptr<slot>> slots;
+static std::shared_ptr<slot> active;
+static std::vector<std::thread> workers;
+static bool running = false;
+
+static bool idle()
+{
+    return std::none_of(slots.begin(), slots.end(), [](const std::shared_ptr<slot>& s) { return s->queued; });
+}
+
+static void worker()
+{
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    for (;;) {
+        task_cv.wait(lock, [] { return !running || !tasks.empty(); });
+        if (tasks.empty())
+            break;
+        auto s = std::move(tasks.front());
+        tasks.pop_front();
+        const bool muted = s != active;
+        lock.unlock();
+
+        std::shared_ptr<const song> snapshot;
+        {
+            std::lock_guard<std::mutex> busy(s->busy);
+            util::mute_covers = muted;
+            s->src->refresh();
+            util::mute_covers = false;
+            snapshot = s->src->snapshot();
+        }
+
+        lock.lock();
+        if (!snapshot->playing())
+            s->playing_since = 0;
+        else if (!s->playing_since)
+            s->playing_since = os_gettime_ns();
+        s->latest = std::move(snapshot);
+        s->queued = false;
+        done_cv.notify_all();
+    }
+}
+
+void start()
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (running)
+        return;
+    running = true;
+    for (const auto& src : music_sources::instances) {
+        auto s = std::make_shared<slot>();
+        s->src = src;
+        slots.push_back(std::move(s));
+    }
+
+    const auto count = std::min<size_t>(slots.size(), MAX_WORKERS);
+    for (size_t i = 0; i < count; i++)
+        workers.emplace_back(worker);
+}
+
+void stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (!running)
+            return;
+        running = false;
+        /* Refreshes that haven't started yet are dropped */
+        for (auto& s : tasks)
+            s->queued = false;
+        tasks.clear();
+    }
+    task_cv.notify_all();
+    for (auto& w : workers)
+        w.join();
+    workers.clear();
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    slots.clear();
+    active.reset();
+    done_cv.notify_all();
+}
+
+/* The source that most recently started playing is shown. If none
+ * is playing the last shown one stays, so its paused info is kept */
+static std::shared_ptr<slot> arbitrate()
+{
+    std::shared_ptr<slot> best;
+    for (const auto& s : slots) {
+        if (s->playing_since && (!best || s->playing_since > best->playing_since))
+            best = s;
+    }
+
+    if (!best)
+        best = active;
+
+    if (!best) {
+        /* Nothing was shown yet, start with the source selected by the user */
+        const auto selected = music_sources::selected_source();
+        for (const auto& s : slots) {
+            if (s->src == selected)
+                best = s;
+        }
+    }
+    return best;
+}
+
+std::shared_ptr<music_source> refresh(int64_t timeout_ms, std::shared_ptr<const song>& out)
+{
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    if (!running)
+        return nullptr;
+
+    for (const auto& s : slots) {
+        if (!s->queued && s->src->enabled()) {
+            s->queued = true;
+            tasks.push_back(s);
+        }
+    }
+    task_cv.notify_all();
+    done_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [] { return !running || idle(); });
+
+    const auto best = arbitrate();
+    if (!best || !best->latest)
+        return nullptr;
+
+    active = best;
+    out = best->latest;
+    return best->src;
+}
+
+bool execute(capability c)
+{
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    const auto s = active;
+    lock.unlock();
+
+    if (!s)
+        return false;
+    std::lock_guard<std::mutex> busy(s->busy);
+    return s->src->execute_capability(c);
+}
+
+void wait_idle()
+{
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    done_cv.wait(lock, [] { return !running || idle(); });
+}
+
+}
@@ -0,0 +1,49 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "../query/music_source.hpp"
+#include <memory>
+#include <stdint.h>
+
+/* Used in automatic source mode: all enabled sources are refreshed in
+ * parallel on a few worker threads and the one that is playing is shown.
+ * The other sources are still refreshed, but can't change the cover */
+namespace source_pool {
+
+/* Started by the tuna thread once automatic mode is turned on */
+void start();
+
+/* Waits for refreshes that are still running and stops the workers */
+void stop();
+
+/* Queues a refresh for every enabled source that isn't still busy with
+ * the previous one and waits at most timeout_ms for them. Sources that take
+ * longer finish in the background and are picked up by a later call.
+ * Returns the source that should be shown and its latest song info */
+std::shared_ptr<music_source> refresh(int64_t timeout_ms, std::shared_ptr<const song>& out);
+
+/* Runs a command on the shown source, once it's done refreshing */
+bool execute(capability c);
+
+/* Blocks until no source is refreshing anymore. Refreshes are only queued
+ * while thread::thread_mutex is held, so with it held this makes sure no
+ * source is in use until it's released */
+void wait_idle();
+
+}
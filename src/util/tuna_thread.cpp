@@ -17,95 +17,357 @@
  *************************************************************************/
 
 #include "tuna_thread.hpp"
+#include "../gui/music_control.hpp"
 #include "../gui/tuna_gui.hpp"
 #include "../query/music_source.hpp"
 #include "config.hpp"
+#include "pipeline.hpp"
+#include "source_pool.hpp"
 #include "utility.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <vector>
 #include <obs-module.h>
+#include <system_error>
+#include <thread>
 #include <util/platform.h>
 
-#ifdef LINUX
+/* How long after the predicted end of a song the source is queried
+ * in adaptive mode, and how often it's queried at most */
+#define TRACK_END_GRACE_MS 100
+#define MIN_REFRESH_MS 100
 
-#include <pthread.h>
+/* Commands beyond that are rejected until the thread caught up */
+#define MAX_QUEUED_COMMANDS 16
 
-#endif
 namespace thread {
-volatile bool thread_flag = false;
-volatile bool thread_running = false;
-song copy;
+std::atomic<bool> thread_flag { false };
+std::atomic<bool> thread_running { false };
 std::mutex thread_mutex;
-std::mutex copy_mutex;
 
-#ifdef _WIN32
-static HANDLE thread_handle;
-#else
-static pthread_t thread_handle;
-#endif
+/* Serializes start() and stop(), so the thread is never joined twice */
+static std::mutex lifecycle_mutex;
+static std::thread worker;
+
+/* Only ever replaced as a whole with std::atomic_store */
+static std::shared_ptr<const song> published_song = std::make_shared<const song>();
+
+/* Used to wake the thread up before its wait time is over */
+static std::mutex wake_mutex;
+static std::condition_variable wake_cv;
+static bool wake_pending = false;
+
+static std::atomic<uint64_t> missed_deadline_count { 0 };
+static std::atomic<int> current_output_state { OUTPUT_IDLE };
+
+struct command {
+    capability cap;
+    std::function<void(bool)> done;
+};
+
+static std::mutex command_mutex;
+static std::deque<command> commands;
+
+/* Swaps in a new snapshot, readers still holding the old one keep it alive.
+ * Copying the song only copies a pointer to its info */
+static std::shared_ptr<const song> publish(const song& s)
+{
+    auto snapshot = std::make_shared<song>(s);
+    /* Only the tuna thread and stop() publish, and never at the same time */
+    snapshot->update_changes(*current_song());
+    std::atomic_store(&published_song, std::shared_ptr<const song>(snapshot));
+    return snapshot;
+}
 
 bool start()
 {
-    bool result = true;
+    std::lock_guard<std::mutex> lock(lifecycle_mutex);
     if (thread_flag)
-        return result;
+        return true;
     thread_flag = true;
+    missed_deadline_count = 0;
+    {
+        /* A wake() from before the last stop() shouldn't skip the first wait */
+        std::lock_guard<std::mutex> wake_lock(wake_mutex);
+        wake_pending = false;
+    }
+    pipeline::start();
 
-#ifdef _WIN32
-    thread_handle = CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(thread_method), nullptr, 0, nullptr);
-    result = thread_handle;
-#else
-    result = pthread_create(&thread_handle, nullptr, thread_method, nullptr) == 0;
-#endif
-    thread_flag = result;
-    thread_running = result;
-    return result;
+    /* Set before the thread exists, it's cleared by the thread once it exits */
+    thread_running = true;
+    try {
+        worker = std::thread(thread_method);
+    } catch (const std::system_error& e) {
+        berr("Couldn't create thread: %s", e.what());
+        thread_flag = false;
+        thread_running = false;
+        pipeline::stop();
+        return false;
+    }
+    return true;
 }
 
 void stop()
 {
+    std::lock_guard<std::mutex> lock(lifecycle_mutex);
+    if (!worker.joinable())
+        return;
     thread_flag = false;
+    /* Interrupts the wait for the next refresh or source event, so this
+     * only has to wait for a refresh that is currently running */
+    wake();
+    worker.join();
+    /* Started by the thread, so only stopped once it's done */
+    source_pool::stop();
+
     /* Set status to noting before stopping */
     auto src = music_sources::selected_source();
     src->reset_info();
-    util::handle_outputs(src->song_info());
+    pipeline::push_song(publish(src->song_info()));
+    /* Waits for outputs and cover to be written */
+    pipeline::stop();
+}
+
+std::shared_ptr<const song> current_song()
+{
+    return std::atomic_load(&published_song);
+}
+
+void wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_pending = true;
+    }
+    wake_cv.notify_one();
 }
 
-#ifdef _WIN32
-DWORD WINAPI thread_method(LPVOID arg)
-#else
-void* thread_method(void* arg)
-#endif
+void post_command(capability c, std::function<void(bool)> done)
 {
-    UNUSED_PARAMETER(arg);
+    std::unique_lock<std::mutex> lock(command_mutex);
+    if (!thread_flag) {
+        /* Sources can block on the network, which shouldn't happen on the
+         * calling thread, and running it once the thread is started again
+         * would be unexpected */
+        lock.unlock();
+        bdebug("Thread isn't running, dropping command %i", c);
+        if (done)
+            done(false);
+        return;
+    }
+
+    if (commands.size() >= MAX_QUEUED_COMMANDS) {
+        lock.unlock();
+        bwarn("Too many queued commands, dropping command %i", c);
+        if (done)
+            done(false);
+        return;
+    }
+
+    commands.push_back({ c, std::move(done) });
+    lock.unlock();
+    wake();
+}
+
+/* Takes all queued commands, so they can be run without holding the lock */
+static std::deque<command> take_commands()
+{
+    std::deque<command> result;
+    std::lock_guard<std::mutex> lock(command_mutex);
+    result.swap(commands);
+    return result;
+}
+
+void set_output_state(output_state state)
+{
+    static const char* names[] = { "idle", "recording", "live" };
+    if (current_output_state.exchange(state) == state)
+        return;
+    binfo("OBS is %s now", names[state]);
+    /* Use the new refresh rate right away */
+    wake();
+}
+
+uint64_t missed_deadlines()
+{
+    return missed_deadline_count;
+}
+
+/* Waits until either the deadline (from os_gettime_ns()) is reached
+ * or wake() was called. A deadline of zero will only return once wake()
+ * was called */
+static void wait_for_wakeup(uint64_t deadline)
+{
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    const auto woken = [] { return wake_pending || !thread_flag; };
+
+    if (deadline == 0) {
+        wake_cv.wait(lock, woken);
+    } else {
+        const auto now = os_gettime_ns();
+        if (deadline > now)
+            wake_cv.wait_for(lock, std::chrono::nanoseconds(deadline - now), woken);
+    }
+    wake_pending = false;
+}
+
+/* The refresh rate for what OBS is currently doing */
+static int64_t base_refresh_rate()
+{
+    if (!config::throttle_refresh)
+        return config::refresh_rate;
+
+    switch (current_output_state) {
+    case OUTPUT_LIVE:
+        return config::refresh_rate;
+    case OUTPUT_RECORDING:
+        return config::recording_refresh_rate;
+    default:
+        return config::idle_refresh_rate;
+    }
+}
+
+/* Nothing is streamed or recorded, so nobody will see the outputs */
+static bool suspended()
+{
+    return config::throttle_refresh && config::suspend_when_idle && current_output_state == OUTPUT_IDLE;
+}
+
+/* Decides how long to wait until the next refresh. In adaptive
+ * mode paused sources are queried less often and playing sources are
+ * queried right after the current song should have ended */
+static int64_t next_refresh_in(const song& s)
+{
+    const int64_t rate = base_refresh_rate();
+    if (!config::adaptive_refresh)
+        return rate;
+
+    if (!s.playing())
+        return std::max<int64_t>(rate, config::paused_refresh_rate);
+
+    if ((s.data() & CAP_DURATION) && (s.data() & CAP_PROGRESS)) {
+        const int64_t remaining = s.get_int_value('l') - s.get_int_value('p');
+        if (remaining >= 0)
+            return std::max<int64_t>(std::min<int64_t>(rate, remaining + TRACK_END_GRACE_MS), MIN_REFRESH_MS);
+    }
+    return rate;
+}
+
+void thread_method()
+{
+    uint64_t deadline = os_gettime_ns();
+    bool was_auto_source = false;
+
     while (thread_flag) {
-        const auto time = util::epoch();
+        /* If we were woken up early this refresh is the new reference
+         * point, if we were woken up late the next deadline will make
+         * up for it */
+        deadline = std::min(deadline, os_gettime_ns());
+        int64_t next_refresh = base_refresh_rate();
+        bool wait_for_event = false;
+        auto pending_commands = take_commands();
+
+        if (suspended() && pending_commands.empty()) {
+            /* set_output_state() wakes us up once OBS is outputting again */
+            wait_for_wakeup(0);
+            deadline = os_gettime_ns();
+            continue;
+        }
+        std::vector<std::pair<std::function<void(bool)>, bool>> results;
+
+        const bool auto_source = config::auto_source;
         thread_mutex.lock();
+        /* The pool only runs in auto mode. Stopping it waits for
+         * sources that are still refreshing on it */
+        if (auto_source && !was_auto_source)
+            source_pool::start();
+        else if (!auto_source && was_auto_source)
+            source_pool::stop();
+        was_auto_source = auto_source;
+
         auto ref = music_sources::selected_source();
-        if (ref) {
+        std::shared_ptr<const song> snapshot, latest;
+
+        /* Run commands right before refreshing, so their effect is
+         * visible in the published song when the caller is notified */
+        for (auto& c : pending_commands) {
+            const bool result = auto_source ? source_pool::execute(c.cap) : ref && ref->execute_capability(c.cap);
+            results.emplace_back(std::move(c.done), result);
+        }
+
+        if (auto_source) {
+            /* A slow source shouldn't delay the others for too long */
+            ref = source_pool::refresh(config::refresh_rate / 2, latest);
+        } else if (ref) {
             ref->refresh();
-            auto s = ref->song_info();
+            latest = ref->snapshot();
+        }
 
-            /* Make a copy for the progress bar source, because it can't
-             * wait for the other processes to finish, otherwise it'll block
-             * the video thread
+        if (latest) {
+            /* Publish a snapshot for the progress bar source, because it
+             * can't wait for the other processes to finish, otherwise it'll
+             * block the video thread
              */
-            copy_mutex.lock();
-            copy = s;
-            copy_mutex.unlock();
-            /* Process song data */
-            util::handle_outputs(s);
+            snapshot = publish(*latest);
+
+            /* Nothing will change until the source tells us, so
+             * there's no point in polling it */
+            wait_for_event = !auto_source && ref->event_driven() && !latest->playing();
+            next_refresh = next_refresh_in(*latest);
         }
+        const bool switched = auto_source && ref && ref != music_sources::selected_source();
         thread_mutex.unlock();
 
-        /* Calculate how long refresh took and only wait the remaining time */
-        const auto delta = util::epoch() - time;
-        const auto wait = config::refresh_rate - delta;
-        os_sleep_ms(wait);
+        if (switched) {
+            binfo("Automatically switched to %s", ref->name());
+            music_sources::select(ref->id());
+            post_source_changed();
+        }
+        /* Don't hold on to the source while waiting */
+        ref.reset();
+
+        for (auto& r : results) {
+            if (r.first)
+                r.first(r.second);
+        }
+
+        /* Formatting and writing outputs happens on the pipeline threads,
+         * so a slow disk doesn't delay the next query */
+        if (snapshot && thread_flag)
+            pipeline::push_song(std::move(snapshot));
+
+        /* The next refresh is scheduled relative to when this one should
+         * have started, so the time the refresh took doesn't add up */
+        deadline += next_refresh * MS_TO_NS;
+        const auto now = os_gettime_ns();
+        if (now > deadline) {
+            /* Don't try to catch up with a burst of refreshes,
+             * just continue from here */
+            missed_deadline_count++;
+            bdebug("Refresh took %llu ms longer than the refresh rate",
+                static_cast<unsigned long long>((now - deadline) / MS_TO_NS));
+            deadline = now;
+        }
+
+        if (wait_for_event) {
+            wait_for_wakeup(0);
+            deadline = os_gettime_ns();
+        } else {
+            wait_for_wakeup(deadline);
+        }
     }
+    /* Commands that came in while stopping won't be run anymore */
+    for (auto& c : take_commands()) {
+        if (c.done)
+            c.done(false);
+    }
+
+    if (missed_deadline_count > 0)
+        binfo("Thread stopped, %llu refreshes took longer than the refresh rate",
+            static_cast<unsigned long long>(missed_deadline_count.load()));
     thread_running = false;
-#ifdef _WIN32
-    return 0;
-#else
-    pthread_exit(nullptr);
-#endif
 }
 } // namespace thread
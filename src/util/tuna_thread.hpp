@@ -18,31 +18,59 @@
 
 #pragma once
 
-#ifdef _WIN32
-#include <Windows.h>
-#endif
-
 #include <QString>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
 
+#include "src/query/music_source.hpp"
 #include "src/query/song.hpp"
 
 namespace thread {
-extern volatile bool thread_flag;
-extern volatile bool thread_running;
+
+/* What OBS is currently outputting. Replay buffers count as recording and
+ * there's no way to tell whether anyone is looking at the preview, so
+ * everything else is idle */
+enum output_state {
+    OUTPUT_IDLE,
+    OUTPUT_RECORDING,
+    OUTPUT_LIVE
+};
+
+extern std::atomic<bool> thread_flag;
+extern std::atomic<bool> thread_running;
 extern std::mutex thread_mutex;
-extern std::mutex copy_mutex;
-extern song copy;
 
 bool start();
 
+/* Wakes the thread up and joins it, so it only waits for a refresh that is
+ * already running. Must not be called while holding thread_mutex */
 void stop();
 
-#ifdef _WIN32
-DWORD WINAPI thread_method(LPVOID arg);
-#else
+/* Latest song info published by the thread. The snapshot is never modified
+ * after publishing, so callers that can't wait for the thread (e.g. the
+ * progress source on the video thread) can read it without locking */
+std::shared_ptr<const song> current_song();
+
+/* Queues a command (next song, play/pause etc.) for the selected source.
+ * The thread runs it before its next refresh and then calls done with the
+ * result, once the refreshed song info was published. done is called from
+ * the tuna thread. While the thread isn't running the command is dropped
+ * and done is called with false right away */
+void post_command(capability c, std::function<void(bool)> done = nullptr);
+
+/* Interrupts the wait between two refreshes, so the next
+ * refresh happens right away instead of on the next tick */
+void wake();
+
+/* Called on OBS frontend events, with refresh throttling enabled the
+ * refresh rate depends on this state */
+void set_output_state(output_state state);
 
-void* thread_method(void*);
+/* Number of refreshes that took longer than the refresh rate
+ * since the thread was started */
+uint64_t missed_deadlines();
 
-#endif
+void thread_method();
 } // namespace thread
@@ -21,6 +21,9 @@
 #include "config.hpp"
 #include "constants.hpp"
 #include "format.hpp"
+#include "log_writer.hpp"
+#include "pipeline.hpp"
+#include "visibility.hpp"
 #include <QGuiApplication>
 #include <QScreen>
 
@@ -49,10 +52,16 @@ void unload_libvlc() {}
 #include <obs-module.h>
 #include <stdio.h>
 #include <util/platform.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace util {
 
 bool vlc_loaded = false;
+thread_local bool mute_covers = false;
 
 void load_vlc()
 {
@@ -163,7 +172,9 @@ void download_lyrics(const song& song)
     }
 }
 
-void download_cover(const song& song, bool reset)
+static void set_placeholder_now(bool on);
+
+static void download_cover_now(const QString& cover, bool reset)
 {
     static QString last_cover = "";
 
@@ -172,15 +183,19 @@ void download_cover(const song& song, bool reset)
         return;
     }
 
-    if (!config::download_cover || song.cover() == last_cover)
+    if (!config::download_cover || cover == last_cover)
         return;
 
     auto found_cover = false;
     auto path = utf8_to_qt(config::cover_path);
+
+    /* Downloaded once an image source shows it again */
+    if (visibility::hidden(path))
+        return;
     auto tmp = path + ".tmp";
 
-    if (song.cover() != "n/a")
-        found_cover = curl_download(qt_to_utf8(song.cover()), qt_to_utf8(tmp));
+    if (cover != "n/a")
+        found_cover = curl_download(qt_to_utf8(cover), qt_to_utf8(tmp));
 
     /* Replace cover only after download is done */
     QFile current(path);
@@ -188,16 +203,24 @@ void download_cover(const song& song, bool reset)
 
     if (found_cover) {
         if (QFile::rename(tmp, utf8_to_qt(config::cover_path)))
-            last_cover = song.cover();
+            last_cover = cover;
         else
             berr("Couldn't rename temporary cover file");
     } else if (last_cover != "n/a") {
         last_cover = "n/a";
-        set_placeholder(true);
+        set_placeholder_now(true);
     }
 }
 
-void reset_cover()
+void download_cover(const song& song, bool reset)
+{
+    if (mute_covers)
+        return;
+    const QString cover = song.cover();
+    pipeline::push_cover([cover, reset] { download_cover_now(cover, reset); }, !reset);
+}
+
+static void reset_cover_now()
 {
     auto path = utf8_to_qt(config::cover_path);
     QFile current(path);
@@ -206,51 +229,173 @@ void reset_cover()
         berr("Couldn't move placeholder cover");
 }
 
-void write_song(config::output& o, const QString& str)
+void reset_cover()
+{
+    if (mute_covers)
+        return;
+    pipeline::push_cover(reset_cover_now);
+}
+
+bool sync_file(QFile& f)
+{
+    if (!f.flush())
+        return false;
+#ifdef _WIN32
+    return _commit(f.handle()) == 0;
+#else
+    return fsync(f.handle()) == 0;
+#endif
+}
+
+/* Writes to a file next to the output and renames it over the output, so
+ * anything reading the output sees either the old or the new text, but
+ * never an empty or half written file */
+static bool write_atomic(const output_write& w)
+{
+    const QString tmp_path = w.path + ".tmp";
+    QFile tmp(tmp_path);
+    if (!tmp.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&tmp);
+    stream.setCodec("UTF-8");
+    stream << w.text;
+    stream.flush();
+
+    /* Only needed to survive a crash of the system, renaming
+     * is enough for everything reading the file */
+    bool success = stream.status() == QTextStream::Ok && (!config::sync_writes || sync_file(tmp));
+    tmp.close();
+    success = success && os_rename(qt_to_utf8(tmp_path), qt_to_utf8(w.path)) == 0;
+    if (!success)
+        tmp.remove();
+    return success;
+}
+
+bool is_text_source(obs_source_t* src)
+{
+    const char* id = obs_source_get_unversioned_id(src);
+    return id && (strcmp(id, "text_gdiplus") == 0 || strcmp(id, "text_ft2_source") == 0);
+}
+
+/* libobs defers updates of video sources to the video thread, where they're
+ * applied before the next frame, so this is safe from the write stage and
+ * needs no file for OBS to poll */
+static void update_text_source(const output_write& w)
 {
-    if (o.last_output == str)
+    auto* src = obs_get_source_by_name(qt_to_utf8(w.path));
+    if (!src) {
+        bwarn("Couldn't find text source %s", qt_to_utf8(w.path));
+        return;
+    }
+    if (!is_text_source(src)) {
+        bwarn("%s isn't a text source", qt_to_utf8(w.path));
+        obs_source_release(src);
         return;
-    o.last_output = str;
+    }
 
-    QFile out(o.path);
-    bool success = false;
-    if (o.log_mode)
-        success = out.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Append);
-    else
-        success = out.open(QIODevice::WriteOnly | QIODevice::Text);
+    auto* settings = obs_data_create();
+    obs_data_set_string(settings, "text", qt_to_utf8(w.text));
+    /* The text would be replaced by the file again, Windows and
+     * Linux/macOS text sources call this setting differently */
+    obs_data_set_bool(settings, "read_from_file", false);
+    obs_data_set_bool(settings, "from_file", false);
+    obs_source_update(src, settings);
+    obs_data_release(settings);
+    obs_source_release(src);
+}
 
-    if (success) {
+void write_song(const output_write& w)
+{
+    if (w.text_source) {
+        update_text_source(w);
+        return;
+    }
+
+    if (w.log_mode) {
+        log_writer::append(w.path, w.text, w.rotation);
+        return;
+    }
+
+    /* Some systems don't allow replacing a file that is open, in that
+     * case it's just overwritten */
+    if (config::atomic_writes && write_atomic(w))
+        return;
+
+    QFile out(w.path);
+    if (out.open(QIODevice::WriteOnly | QIODevice::Text)) {
         QTextStream stream(&out);
         stream.setCodec("UTF-8");
-        stream << str;
-        if (o.log_mode)
-            stream << "\n";
+        stream << w.text;
         stream.flush();
         out.close();
     } else {
-        berr("Couldn't open song output file %s", qt_to_utf8(o.path));
+        berr("Couldn't open song output file %s", qt_to_utf8(w.path));
     }
 }
 
-void handle_outputs(const song& s)
+/* The placeholder with the workaround for spaces applied, only
+ * converted again if it changes */
+static const QString& placeholder_text()
 {
-    static QString tmp_text = "";
+    static QByteArray source;
+    static QString text;
+
+    if (source != config::placeholder) {
+        source = config::placeholder;
+        /* OBS seems to cut leading and trailing spaces
+         * when loading the config file so this workaround
+         * allows users to still use them */
+        text = utf8_to_qt(config::placeholder);
+        text.replace("%s", " ");
+    }
+    return text;
+}
+
+void handle_outputs(const song& s, QList<output_write>& changed)
+{
+    /* Shared by all outputs, guarded by outputs_mutex */
+    static format::value_cache cache;
+    std::lock_guard<std::mutex> lock(config::outputs_mutex);
+    visibility::update();
+    cache.reset();
 
     for (auto& o : config::outputs) {
-        tmp_text.clear();
-        tmp_text = o.format;
-        format::execute(tmp_text);
-
-        if (tmp_text.isEmpty() || !s.playing()) {
-            tmp_text = config::placeholder;
-            /* OBS seems to cut leading and trailing spaces
-             * when loading the config file so this workaround
-             * allows users to still use them */
-            tmp_text.replace("%s", " ");
+        /* Not updating last_output makes sure it's written once it's visible */
+        if (!o.log_mode && visibility::hidden(o.path))
+            continue;
+        if (o.compiled.source() != o.format) {
+            o.compiled = format::compiled_format(o.format);
+            o.generation = 0;
+        }
+
+        /* The placeholder is used depending on the play state, so that's
+         * always relevant. If songs were skipped changed() doesn't cover
+         * everything since the last formatting */
+        const auto fields = o.compiled.fields() | CAP_STATUS;
+        if (o.generation && (s.generation() == o.generation || (s.generation() == o.generation + 1 && !(s.changed() & fields)))) {
+            o.generation = s.generation();
+            continue;
+        }
+        o.generation = s.generation();
+
+        /* truncate() keeps the capacity, clear() wouldn't */
+        o.buffer.truncate(0);
+        o.compiled.execute(o.buffer, s, &cache);
+
+        if (o.buffer.isEmpty() || !s.playing()) {
+            o.buffer.truncate(0);
+            o.buffer.append(placeholder_text());
         }
         if (!s.playing() && o.log_mode)
             continue; /* No song playing text doesn't make sense in the log */
-        write_song(o, tmp_text);
+        if (o.last_output == o.buffer)
+            continue;
+        o.last_output.swap(o.buffer);
+        /* The write gets its own copy. Sharing last_output would make the next
+         * truncate() of the buffer detach while the writer still holds it */
+        const QString text(o.last_output.unicode(), o.last_output.size());
+        changed.append(output_write { o.path, text, o.log_mode, o.text_source, o.rotation });
     }
 }
 
@@ -268,7 +413,7 @@ bool window_pos_valid(QRect rect)
     return false;
 }
 
-void set_placeholder(bool on)
+static void set_placeholder_now(bool on)
 {
     static int8_t last_state = -1;
 
@@ -302,4 +447,11 @@ void set_placeholder(bool on)
     }
 }
 
+void set_placeholder(bool on)
+{
+    if (mute_covers)
+        return;
+    pipeline::push_cover([on] { set_placeholder_now(on); });
+}
+
 } // namespace util
@@ -18,8 +18,10 @@
 
 #pragma once
 
+#include <QList>
 #include <QRect>
 #include <QString>
+#include "log_writer.hpp"
 #include <obs-module.h>
 #include <stdint.h>
 
@@ -34,24 +36,50 @@
 #define berr(format, ...) write_log(LOG_ERROR, format, ##__VA_ARGS__)
 
 #define SECOND_TO_NS 1000000000
+#define MS_TO_NS 1000000
 class song;
+class QFile;
 
 namespace util {
 extern bool vlc_loaded;
 
+/* Set while a source that isn't the shown one is refreshed in automatic
+ * source mode, so it doesn't replace the cover of the active source */
+extern thread_local bool mute_covers;
+
+/* Output text that changed and still has to be written */
+struct output_write {
+    QString path;
+    QString text;
+    bool log_mode;
+    bool text_source; /* path is the name of an OBS text source */
+    log_writer::rotation rotation;
+};
+
 void load_vlc();
 
 void unload_vlc();
 
 bool curl_download(const char* url, const char* path);
 
+/* Cover changes are queued on the cover thread, see pipeline.hpp */
 void download_cover(const song& song, bool reset = false);
 
 void reset_cover();
 
 void download_lyrics(const song& song);
 
-void handle_outputs(const song& song);
+/* Formats all outputs and collects the ones that changed */
+void handle_outputs(const song& song, QList<output_write>& changed);
+
+void write_song(const output_write& w);
+
+/* True for the Windows and Linux/macOS text sources, the only ones
+ * outputs can write to */
+bool is_text_source(obs_source_t* src);
+
+/* Flushes the file and waits until its content is on disk */
+bool sync_file(QFile& f);
 
 void set_placeholder(bool on);
 
@@ -0,0 +1,221 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "visibility.hpp"
+#include "config.hpp"
+#include "tuna_thread.hpp"
+#include "utility.hpp"
+#include <QDir>
+#include <QHash>
+#include <atomic>
+#include <mutex>
+#include <obs-module.h>
+
+namespace visibility {
+
+/* Path -> whether any source showing that file is visible */
+static std::mutex paths_mutex;
+static QHash<QString, bool> paths;
+
+static QString normalize(const QString& path)
+{
+    auto result = QDir::cleanPath(QDir::fromNativeSeparators(path));
+#ifdef _WIN32
+    result = result.toLower();
+#endif
+    return result;
+}
+
+/* Returns the file a text or image source displays, if any */
+static QString source_file(obs_source_t* src)
+{
+    const char* id = obs_source_get_id(src);
+    if (!id)
+        return "";
+
+    QString result;
+    obs_data_t* settings = obs_source_get_settings(src);
+    if (!settings)
+        return "";
+
+    if (strncmp(id, "text_gdiplus", 12) == 0) {
+        if (obs_data_get_bool(settings, "read_from_file"))
+            result = obs_data_get_string(settings, "file");
+    } else if (strncmp(id, "text_ft2_source", 15) == 0) {
+        if (obs_data_get_bool(settings, "from_file"))
+            result = obs_data_get_string(settings, "text_file");
+    } else if (strcmp(id, "image_source") == 0) {
+        result = obs_data_get_string(settings, "file");
+    }
+    obs_data_release(settings);
+    return result;
+}
+
+/* Only sources that source_file() knows can change which files are shown */
+static bool displays_file(obs_source_t* src)
+{
+    const char* id = obs_source_get_id(src);
+    return id && (strncmp(id, "text_gdiplus", 12) == 0 || strncmp(id, "text_ft2_source", 15) == 0 || strcmp(id, "image_source") == 0);
+}
+
+/* Set by the signal handlers, the paths are only looked up again once
+ * a source was shown, hidden, added, removed or its file changed */
+static std::atomic<bool> dirty { true };
+
+/* Source -> the file it displayed when it was last created or updated.
+ * Outputs that write to text sources update them on every song, which
+ * mostly doesn't change the file */
+static std::mutex files_mutex;
+static QHash<obs_source_t*, QString> files;
+
+static void on_update(void*, calldata_t* data)
+{
+    auto* src = static_cast<obs_source_t*>(calldata_ptr(data, "source"));
+    if (!src)
+        return;
+    const auto file = source_file(src);
+    std::lock_guard<std::mutex> lock(files_mutex);
+    auto& known = files[src];
+    if (known != file) {
+        known = file;
+        dirty = true;
+    }
+}
+
+static void on_show(void*, calldata_t* data)
+{
+    auto* src = static_cast<obs_source_t*>(calldata_ptr(data, "source"));
+    if (!src || !displays_file(src))
+        return;
+    dirty = true;
+    if (!config::skip_hidden || source_file(src).isEmpty())
+        return;
+    /* Deferred outputs and covers should show up right away */
+    thread::wake();
+}
+
+static void on_change(void*, calldata_t* data)
+{
+    auto* src = static_cast<obs_source_t*>(calldata_ptr(data, "source"));
+    if (src && displays_file(src))
+        dirty = true;
+}
+
+static void on_destroy(void*, calldata_t* data)
+{
+    auto* src = static_cast<obs_source_t*>(calldata_ptr(data, "source"));
+    if (!src || !displays_file(src))
+        return;
+    dirty = true;
+    std::lock_guard<std::mutex> lock(files_mutex);
+    files.remove(src);
+}
+
+static void connect_update(obs_source_t* src, bool connect)
+{
+    if (!displays_file(src))
+        return;
+    auto* handler = obs_source_get_signal_handler(src);
+    if (connect) {
+        {
+            std::lock_guard<std::mutex> lock(files_mutex);
+            files[src] = source_file(src);
+        }
+        signal_handler_connect(handler, "update", on_update, nullptr);
+    } else {
+        signal_handler_disconnect(handler, "update", on_update, nullptr);
+    }
+}
+
+static bool connect_existing(void* param, obs_source_t* src)
+{
+    connect_update(src, *static_cast<bool*>(param));
+    return true;
+}
+
+static void on_create(void*, calldata_t* data)
+{
+    auto* src = static_cast<obs_source_t*>(calldata_ptr(data, "source"));
+    if (!src || !displays_file(src))
+        return;
+    connect_update(src, true);
+    dirty = true;
+}
+
+void init()
+{
+    auto* handler = obs_get_signal_handler();
+    signal_handler_connect(handler, "source_show", on_show, nullptr);
+    signal_handler_connect(handler, "source_hide", on_change, nullptr);
+    signal_handler_connect(handler, "source_create", on_create, nullptr);
+    signal_handler_connect(handler, "source_remove", on_change, nullptr);
+    signal_handler_connect(handler, "source_destroy", on_destroy, nullptr);
+
+    /* Sources that were created before the plugin was loaded */
+    bool connect = true;
+    obs_enum_sources(connect_existing, &connect);
+    dirty = true;
+}
+
+void deinit()
+{
+    auto* handler = obs_get_signal_handler();
+    signal_handler_disconnect(handler, "source_show", on_show, nullptr);
+    signal_handler_disconnect(handler, "source_hide", on_change, nullptr);
+    signal_handler_disconnect(handler, "source_create", on_create, nullptr);
+    signal_handler_disconnect(handler, "source_remove", on_change, nullptr);
+    signal_handler_disconnect(handler, "source_destroy", on_destroy, nullptr);
+    bool connect = false;
+    obs_enum_sources(connect_existing, &connect);
+
+    std::lock_guard<std::mutex> lock(files_mutex);
+    files.clear();
+}
+
+void update()
+{
+    /* Cleared before the lookup, so changes during it aren't missed */
+    if (!config::skip_hidden || !dirty.exchange(false))
+        return;
+
+    QHash<QString, bool> found;
+    const auto cb = [](void* param, obs_source_t* src) {
+        auto* result = static_cast<QHash<QString, bool>*>(param);
+        const auto file = source_file(src);
+        if (!file.isEmpty()) {
+            auto& visible = (*result)[normalize(file)];
+            visible = visible || obs_source_showing(src);
+        }
+        return true;
+    };
+    obs_enum_sources(cb, &found);
+
+    std::lock_guard<std::mutex> lock(paths_mutex);
+    paths.swap(found);
+}
+
+bool hidden(const QString& path)
+{
+    if (!config::skip_hidden)
+        return false;
+    std::lock_guard<std::mutex> lock(paths_mutex);
+    const auto it = paths.constFind(normalize(path));
+    return it != paths.constEnd() && !it.value();
+}
+
+}
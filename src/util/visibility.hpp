@@ -0,0 +1,42 @@
+/*************************************************************************
+ * This file is part of tuna
+ * github.con/univrsal/tuna
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <QString>
+
+/* Keeps track of which files are shown by OBS text and image sources.
+ * Outputs and covers that are only used by hidden sources can be skipped,
+ * they're caught up on as soon as one of the sources is shown again.
+ * Files no source reads from are never skipped, since other programs
+ * might use them */
+namespace visibility {
+
+void init();
+
+void deinit();
+
+/* Called once per refresh before the outputs are formatted. The file paths
+ * of all text and image sources are only looked up again if OBS signaled
+ * that a source was shown, hidden, added, removed or changed */
+void update();
+
+/* True if skipping hidden outputs is enabled and all sources that
+ * display this file are hidden */
+bool hidden(const QString& path);
+
+}